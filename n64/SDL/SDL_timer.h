@@ -3,6 +3,7 @@
 
 #include <libdragon.h>
 #include "SDL.h"
+#include "../n64_sched.h"
 
 static inline Uint32 SDL_GetTicks()
 {
@@ -11,16 +12,8 @@ static inline Uint32 SDL_GetTicks()
 
 static inline void SDL_Delay(Uint32 ms)
 {
-    unsigned long long timeout = timer_ticks() + TICKS_FROM_MS(ms);
-    do
-    {
-        if (audio_can_write())
-        {
-            short *buf = audio_write_begin();
-            mixer_poll(buf, audio_get_buffer_length());
-            audio_write_end();
-        }
-    } while (timer_ticks() < timeout);
+    //Audio is refilled from the AI interrupt, so the time is free for background work.
+    sched_delay(ms);
 }
 
 #endif
\ No newline at end of file
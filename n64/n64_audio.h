@@ -0,0 +1,108 @@
+#ifndef _N64_AUDIO_H
+#define _N64_AUDIO_H
+
+#include <libdragon.h>
+
+//Maximum number of libdragon mixer channels. Channel 0 is reserved for music, the rest are sfx voices.
+//Each audio profile picks how many of these it actually uses.
+#ifndef AUDIO_MIXER_CHANNELS
+#define AUDIO_MIXER_CHANNELS 16
+#endif
+
+#define MUSIC_CHANNEL 0
+#define SFX_FIRST_CHANNEL 1
+#define SFX_MAX_VOICES (AUDIO_MIXER_CHANNELS - SFX_FIRST_CHANNEL)
+
+#if SFX_MAX_VOICES < 1
+#error AUDIO_MIXER_CHANNELS must leave atleast one channel for sfx
+#endif
+
+//Audio quality profiles. These set the output, music and sfx sample rates and the mixer
+//channel count together so fidelity can be traded for CPU time.
+//The AI always outputs stereo; music and sfx are generated mono in every profile.
+typedef enum
+{
+    AUDIO_PROFILE_FULL,     //44100Hz output, music and sfx at their original rates
+    AUDIO_PROFILE_LOW_COST, //22050Hz output, half rate music and sfx, half the voices
+    AUDIO_PROFILE_MATCHED,  //Everything at 22050Hz so the mixer never resamples
+    AUDIO_PROFILE_MAX
+} audio_profile_id_t;
+
+//Profile used when the config does not specify one. Can be set from the Makefile.
+#ifndef AUDIO_PROFILE
+#define AUDIO_PROFILE AUDIO_PROFILE_FULL
+#endif
+
+typedef struct audio_profile_t
+{
+    const char *name;
+    int output_rate;
+    int music_rate;
+    int sfx_rate;
+    int mixer_channels;
+} audio_profile_t;
+
+const audio_profile_t *audio_get_profile(void);
+
+//mixer_poll runs from the AI interrupt, and the music and sfx read callbacks it calls (OPL synthesis, the
+//music window DMA, sfx decoding) run there with it. audio_lock keeps that interrupt out while the game touches
+//state it shares with them:
+// - the mixer channel table, through mixer_ch_play and mixer_ch_stop (n64_music.c, n64_sfx.c)
+// - the sfx voice table, which voice_alloc reclaims by asking the mixer which channels are still playing
+// - the rspq write pointer, which the mixer's RSP job moves while it queues from the interrupt (n64_video.c)
+//The music track and window state is only changed while the music channel is stopped, so it needs no lock.
+//Everything above is a handful of stores, keep it that way so the AI interrupt is never held off for long.
+static inline void audio_lock(void)
+{
+    disable_interrupts();
+}
+
+static inline void audio_unlock(void)
+{
+    enable_interrupts();
+}
+
+//Audio pipeline instrumentation. Times are in CPU count ticks (TICKS_PER_SECOND).
+typedef enum
+{
+    AUDIO_STAT_MIXER,
+    AUDIO_STAT_MUSIC,
+    AUDIO_STAT_SFX,
+    AUDIO_STAT_MAX
+} audio_stat_id_t;
+
+typedef struct audio_cost_t
+{
+    uint32_t calls;
+    uint32_t ticks_total;
+    uint32_t ticks_max;
+} audio_cost_t;
+
+typedef struct audio_stats_t
+{
+    uint32_t refills;          //Number of AI buffers refilled
+    uint32_t underruns;        //Refills that happened after the AI had already run dry
+    uint32_t fill_last;        //Samples still queued in the AI when the last refill happened
+    uint32_t fill_min;         //Lowest number of samples queued in the AI at refill time
+    uint32_t gap_max_ticks;    //Worst time between two refills
+    audio_cost_t cost[AUDIO_STAT_MAX];
+} audio_stats_t;
+
+void audio_stats_record(audio_stat_id_t id, uint32_t ticks);
+void audio_get_stats(audio_stats_t *stats);
+void audio_reset_stats(void);
+void audio_log_stats(void);
+
+//Logs the stats once every AUDIO_STATS_LOG_INTERVAL_MS. Call from the game loop, not an interrupt.
+void audio_poll_stats(void);
+
+uint32_t music_bank_num_tracks(void);
+uint32_t music_bank_track_length(uint32_t index);
+
+//Render the next sfx wave that load_sfx left for later. Returns false once they are all done.
+bool sfx_load_step(void);
+
+void sfx_close(void);
+void music_close(void);
+
+#endif
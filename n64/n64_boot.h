@@ -0,0 +1,20 @@
+#ifndef _N64_BOOT_H
+#define _N64_BOOT_H
+
+//Boot work that the first screens do not need is split into stages that run as an idle task, so it gets done
+//while the intro dialog and the main menu wait for input instead of before anything is shown.
+//Stages run in order, the main menu's assets first.
+
+//Call first thing in main. Boot times are logged relative to this and to power on.
+void boot_init(void);
+
+//Queue the deferred stages. Call once game_init has returned.
+void boot_start(void);
+
+//Run whatever is left of the stages straight away. Call before anything that needs all of it, like load_level.
+void boot_finish(void);
+
+//Called by video_update. Logs the time to the first frame once.
+void boot_frame_shown(void);
+
+#endif
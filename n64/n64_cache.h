@@ -0,0 +1,35 @@
+#ifndef _N64_CACHE_H
+#define _N64_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Resident asset cache, only enabled on consoles with the Expansion Pak. One block of RAM is set aside at boot
+//and decoded assets (VOL/STN entries, music tracks) are kept in it under a name, so loading one again is a
+//memcpy instead of a DMA and a decode. When it is full the least recently used entries are dropped.
+//Without the Pak nothing is reserved and every call here is a no-op, so loading streams as before.
+#ifndef CACHE_SIZE
+#define CACHE_SIZE (3 * 1024 * 1024)
+#endif
+#define CACHE_MAX_ENTRIES 128
+#define CACHE_KEY_LEN 32
+#define CACHE_ALIGN 16
+
+//Detect the Expansion Pak and reserve the cache if it is there. Call once at boot.
+void cache_init(void);
+bool cache_enabled(void);
+
+//Resident copy of key, or NULL. Marks it as the most recently used.
+const void *cache_get(const char *key, uint32_t *size);
+
+//Room for size bytes under key, evicting old entries as needed. The caller fills it in straight away.
+//NULL if the cache is disabled or the entry could never fit.
+void *cache_put(const char *key, uint32_t size);
+
+//Pinned entries are never evicted. For data that is read from an interrupt, like the playing music track.
+void cache_pin(const void *data, bool pinned);
+
+//Keys are formed from the archive and entry name, eg "GFX.VOL/TITLE1.MNI"
+void cache_make_key(char *key, const char *archive, const char *name);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _N64_CONFIG_H
+#define _N64_CONFIG_H
+
+#include <stdint.h>
+
+//Settings specific to the N64 port. These are kept in their own SRAM file so the
+//game's own config file format is untouched.
+typedef struct n64_config_t
+{
+    uint8_t game_interval; //ms per game tick, see sched_set_game_interval
+} n64_config_t;
+
+extern n64_config_t n64_config;
+
+void n64_config_load(void);
+void n64_config_save(void);
+
+//Saving is a synchronous SRAM commit, so settings changed during play are only marked here and written by
+//n64_config_flush at the next pause, level load or exit.
+void n64_config_changed(void);
+void n64_config_flush(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _N64_CRC_H
+#define _N64_CRC_H
+
+#include <stdint.h>
+
+//Standard CRC-32. Pass 0 to start, or a previous result to continue it.
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t len);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _N64_GFX_H
+#define _N64_GFX_H
+
+//Tilesets and fullscreen images converted from the game's planar EGA data at build time by tools/mkgfx.
+//They are stored in GFX.VOL under their original names, already in the layout the game uses:
+//  tilesets: an array of Tile (uint32 type, then TILE_WIDTH * TILE_HEIGHT 8bpp pixels), big endian
+//  fullscreen images: SCREEN_WIDTH * SCREEN_HEIGHT 8bpp pixels
+//Masked pixels are GFX_TRANSPARENT, the same as the game's TRANSPARENT_COLOR.
+#define GFX_ARCHIVE "GFX.VOL"
+#define GFX_TILE_PIXELS 64
+#define GFX_TILE_SIZE (4 + GFX_TILE_PIXELS)
+#define GFX_IMAGE_SIZE (320 * 200)
+#define GFX_TRANSPARENT 255
+
+//Values of the game's TileType
+#define GFX_TYPE_SOLID 0
+#define GFX_TYPE_TRANSPARENT 1
+#define GFX_TYPE_FONT 2
+
+//Check every converted asset against the game's own converter and log any difference
+#ifndef GFX_VERIFY
+#define GFX_VERIFY 0
+#endif
+
+#endif
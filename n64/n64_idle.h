@@ -0,0 +1,25 @@
+#ifndef _N64_IDLE_H
+#define _N64_IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Background work that runs whenever the game is waiting (SDL_Delay, timed dialogs).
+//A task does one small piece of work per call and returns false once it has nothing left to do.
+typedef bool (*idle_task_t)(void);
+
+#ifndef IDLE_MAX_TASKS
+#define IDLE_MAX_TASKS 4
+#endif
+
+//A task is only started if at least this long is left before the deadline
+#ifndef IDLE_SLICE_US
+#define IDLE_SLICE_US 2000
+#endif
+
+void idle_add_task(idle_task_t task);
+
+//Run tasks until deadline (in timer_ticks) or until none of them has any work.
+void idle_run(uint64_t deadline);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _N64_LATENCY_H
+#define _N64_LATENCY_H
+
+#include <stdint.h>
+
+//Follows button presses from the VI sample through the game tick that reads them to the frame that shows the result,
+//and logs per stage histograms over ISViewer. Compiled out unless INPUT_LATENCY_STATS is set.
+#ifndef INPUT_LATENCY_STATS
+#define INPUT_LATENCY_STATS 0
+#endif
+
+#ifndef LATENCY_BUCKET_US
+#define LATENCY_BUCKET_US 8000
+#endif
+#define LATENCY_NUM_BUCKETS 16
+
+//Log the histograms after this many presses
+#ifndef LATENCY_LOG_EVERY
+#define LATENCY_LOG_EVERY 32
+#endif
+
+typedef enum
+{
+    LATENCY_QUEUE,   //Sampled on a vblank until a game tick reads it
+    LATENCY_TICK,    //Read by the tick until the next video_update starts
+    LATENCY_PRESENT, //Waiting in video_update for a free framebuffer
+    LATENCY_RENDER,  //Building the frame until it is handed to the RDP
+    LATENCY_SCANOUT, //Handed to the RDP until the next vblank
+    LATENCY_TOTAL,
+    LATENCY_STAGE_MAX
+} latency_stage_t;
+
+#if INPUT_LATENCY_STATS
+void latency_init(void);
+
+//Once per game tick, with the time of the earliest press it consumed (0 if none)
+void latency_tick(uint64_t press_ticks);
+
+//From video_update: on entry, once it has a framebuffer and once the frame is submitted
+void latency_frame_begin(void);
+void latency_frame_locked(void);
+void latency_frame_submitted(void);
+
+void latency_log(void);
+#else
+static inline void latency_init(void) {}
+static inline void latency_tick(uint64_t press_ticks) { (void)press_ticks; }
+static inline void latency_frame_begin(void) {}
+static inline void latency_frame_locked(void) {}
+static inline void latency_frame_submitted(void) {}
+static inline void latency_log(void) {}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _N64_LZ_H
+#define _N64_LZ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Byte oriented LZ77 codec using the LZ4 block format. Compression is a single greedy pass with a small
+//hash table, and decompression is simple enough to run at close to memcpy speed on the VR4300.
+//This file is shared with the host tools, so it only depends on the C library.
+
+//Worst case compressed size for len bytes of input
+#define LZ_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+//Returns the compressed size, or 0 if it would not fit in dst_max bytes.
+uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_max);
+
+//Returns the number of bytes written to dst, or 0 if the input is corrupt or does not fit in dst_len.
+uint32_t lz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len);
+
+//Streaming decoder for input that arrives in pieces, for example DMA chunks from the cart.
+//Output goes straight into one buffer, which must hold the whole decompressed data.
+typedef struct lz_stream_t
+{
+    uint8_t *dst;
+    uint32_t dst_len;
+    uint32_t op;
+    uint8_t state;
+    uint8_t token;
+    uint32_t len;
+    uint32_t offset;
+} lz_stream_t;
+
+void lz_stream_init(lz_stream_t *s, uint8_t *dst, uint32_t dst_len);
+
+//Returns false if the input is corrupt or overflows dst.
+bool lz_stream_feed(lz_stream_t *s, const uint8_t *src, uint32_t len);
+
+//True once a whole block has been decoded and filled dst exactly.
+bool lz_stream_done(const lz_stream_t *s);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _N64_MEM_H
+#define _N64_MEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Tagged heap allocations, so the memory report can show where RDRAM goes.
+//The engine calls malloc directly, so its own allocations only show up in the heap totals. Anything the port
+//allocates and hands over for the engine to free is MEM_TAG_MISC.
+typedef enum
+{
+    MEM_TAG_VIDEO,
+    MEM_TAG_AUDIO,
+    MEM_TAG_SAVE,
+    MEM_TAG_CACHE,
+    MEM_TAG_MISC,
+    MEM_TAG_MAX
+} mem_tag_t;
+
+typedef struct mem_tag_stats_t
+{
+    uint32_t bytes;       //Currently allocated
+    uint32_t allocations; //Currently allocated
+    uint32_t peak;        //High water mark of bytes
+    uint32_t total;       //Allocations made since boot
+} mem_tag_stats_t;
+
+void *mem_alloc(mem_tag_t tag, size_t size);
+void *mem_calloc(mem_tag_t tag, size_t num, size_t size);
+void *mem_memalign(mem_tag_t tag, size_t align, size_t size);
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size);
+void mem_free(mem_tag_t tag, void *ptr);
+
+void mem_get_stats(mem_tag_t tag, mem_tag_stats_t *stats);
+
+//Print every tag plus the state of the heap over ISViewer
+void mem_report(const char *reason);
+
+#endif
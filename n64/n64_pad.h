@@ -0,0 +1,44 @@
+#ifndef _N64_PAD_H
+#define _N64_PAD_H
+
+#include <libdragon.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Controller 1 is sampled once per vblank from the VI interrupt. Every change in its buttons is queued with the time
+//it was seen, so the game never talks to the joybus itself and a tap between two reads is not lost.
+#ifndef PAD_QUEUE_SIZE
+#define PAD_QUEUE_SIZE 32
+#endif
+
+#if (PAD_QUEUE_SIZE & (PAD_QUEUE_SIZE - 1)) != 0
+#error PAD_QUEUE_SIZE must be a power of two
+#endif
+
+//Button bits of SI_condat.data, the bottom 16 bits are the stick
+#define PAD_BUTTONS_MASK 0xFFFF0000
+
+typedef struct pad_event_t
+{
+    uint64_t ticks;   //timer_ticks when the sample was taken
+    uint32_t vblank;  //Vblank it was taken on, counted from pad_init
+    uint32_t data;    //SI_condat data word
+    uint32_t pressed; //Buttons that went down since the previous sample
+} pad_event_t;
+
+typedef struct pad_input_t
+{
+    struct controller_data held; //Latest sample, plus any button pressed and released again since the last read
+    struct controller_data down; //Buttons pressed since the last read, with the latest stick position
+    uint64_t first_press_ticks;  //When the earliest of those presses was sampled, 0 if there were none
+    uint32_t events;             //Number of queued changes consumed
+    uint32_t dropped;            //Changes folded into the newest one because the queue was full
+} pad_input_t;
+
+void pad_init(void);
+
+//Take everything queued since the last read or flush.
+void pad_read(pad_input_t *input);
+void pad_flush(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _N64_PREFETCH_H
+#define _N64_PREFETCH_H
+
+#include <stdbool.h>
+
+//Stages the assets of the levels the player can go to next while the current one is being played and
+//through the end of level screens, so load_level finds them already in RAM. Runs as an idle task.
+void prefetch_init(void);
+
+//Called on every input poll. The first one after a level map was loaded means the level is ready. Returns true
+//then, and prints the memory report.
+bool prefetch_level_started(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _N64_QUICKSAVE_H
+#define _N64_QUICKSAVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Snapshot of the engine's complete mutable state (actors, map, player, effects, status...), LZ compressed
+//into the part of SRAM after the save files. That is the engine's .data and .bss plus every heap block it
+//allocated itself. A snapshot is only restored on the level it was taken on, while the engine still holds the
+//same heap blocks.
+bool quicksave_save(void);
+bool quicksave_load(void);
+
+//Buffers the port allocates and hands to the engine, like converted graphics. They are checked to still be in
+//place on a quickload but not saved, so the engine must only read them.
+void quicksave_track_asset(void *ptr, uint32_t size);
+
+//For blocks the port frees on the engine's behalf
+void quicksave_untrack(void *ptr);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _N64_SCHED_H
+#define _N64_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Release waits on the vblank nearest their deadline so game ticks line up with the VI refresh
+#ifndef SCHED_VSYNC
+#define SCHED_VSYNC 1
+#endif
+
+//cosmo_wait deadlines are chained from the previous one. After a stall longer than this the chain restarts from now
+//instead of rushing through the missed waits.
+#ifndef SCHED_RESYNC_MS
+#define SCHED_RESYNC_MS 250
+#endif
+
+//Game tick interval in ms, COSMO_INTERVAL in the engine. 100 is the original game speed.
+#ifndef COSMO_INTERVAL_DEFAULT
+#define COSMO_INTERVAL_DEFAULT 100
+#endif
+#define SCHED_INTERVAL_MIN 20
+#define SCHED_INTERVAL_MAX 250
+#define SCHED_INTERVAL_STEP 10
+
+//Most game ticks in a row that may run without drawing while the game is behind
+#ifndef SCHED_MAX_FRAME_SKIP
+#define SCHED_MAX_FRAME_SKIP 2
+#endif
+
+//Needs the libdragon timer running.
+void sched_init(void);
+
+//Run idle tasks until the deadline (in timer_ticks), then wait out the rest of it.
+void sched_wait_until(uint64_t deadline);
+
+//Wait ms from now.
+void sched_delay(uint32_t ms);
+
+//Wait ms from the end of the previous sched_wait, so the work done in between does not add up into drift.
+void sched_wait(uint32_t ms);
+
+uint32_t sched_vblank_count(void);
+
+uint32_t sched_game_interval(void);
+void sched_set_game_interval(uint32_t ms);
+
+//Called at the start of every game tick. A tick that started later than its interval allows means the game is behind.
+void sched_tick(void);
+
+//The game was held up by something other than its own ticks, like a menu, a dialog or a level load. The next tick
+//is not counted as late.
+void sched_resync(void);
+
+//Asked by video_update. Only the frame of a game tick that is behind is ever skipped, and never more than
+//SCHED_MAX_FRAME_SKIP in a row, so fades and dialogs always draw.
+bool sched_skip_frame(void);
+
+#endif
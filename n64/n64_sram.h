@@ -0,0 +1,42 @@
+#ifndef _N64_SRAM_H
+#define _N64_SRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//SRAM is addressed as one linear region here. Transfers that cross a 32kB bank are split automatically.
+#define SRAM_SECTOR_SIZE 16
+#define SRAM_BANK_SIZE 0x8000
+#define SRAM_NUM_BANKS 3
+#define SRAM_MAX_SIZE (SRAM_BANK_SIZE * SRAM_NUM_BANKS)
+
+//What the cart actually has. Must match N64_ROM_SAVETYPE, sram256k is 256kbit (32kB).
+#ifndef SRAM_SIZE
+#define SRAM_SIZE 0x8000
+#endif
+
+//The save files (n64_save.c) never reach past this. The quicksave starts where they end.
+#define SRAMFS_END 0x2000
+
+//Number of transfers that can be queued before a submit has to wait for one to finish.
+#ifndef SRAM_DMA_QUEUE_SIZE
+#define SRAM_DMA_QUEUE_SIZE 8
+#endif
+
+void sram_init(void);
+
+//Queue a transfer and return straight away. It completes from the PI interrupt, so the RAM buffer
+//must stay valid (and for writes, unchanged) until sram_dma_wait() returns or sram_dma_busy() is false.
+//Sector aligned transfers from 16 byte aligned buffers go straight to RAM, anything else goes
+//through a bounce sector.
+//Both return a ticket for sram_dma_wait_ticket. Tickets are handed out in queue order.
+uint32_t sram_dma_read(void *ram, uint32_t offset, uint32_t len);
+uint32_t sram_dma_write(const void *ram, uint32_t offset, uint32_t len);
+
+bool sram_dma_busy(void);
+void sram_dma_wait(void);
+
+//Wait until the transfer with this ticket, and everything queued before it, has completed. 0 never waits.
+void sram_dma_wait_ticket(uint32_t ticket);
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef _N64_VOL_H
+#define _N64_VOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Prebuilt lookup index for the VOL/STN archives, generated by tools/mkvolindex into the DFS.
+//Entries are found with a hash and displace perfect hash, so an open is a fixed number of probes
+//and never touches the archive directories in ROM.
+//
+//mkvolindex can also repack the archives with each entry LZ compressed (n64/n64_lz.h). Entries that do not
+//shrink enough, or that are read in place from ROM, stay raw. The index records both sizes.
+//
+//Layout (big endian), every table padded to 4 bytes:
+//  vol_index_header_t
+//  char archive_names[num_archives][VOL_INDEX_ARCHIVE_LEN]
+//  uint16 displacement[num_buckets]
+//  uint16 slots[num_slots]        index into entries, or VOL_INDEX_EMPTY
+//  vol_index_entry_t entries[num_entries]
+#define VOL_INDEX_FILENAME "VOLINDEX.BIN"
+#define VOL_INDEX_MAGIC 0x56494458 //VIDX
+#define VOL_INDEX_VERSION 2
+#define VOL_INDEX_NAME_LEN 12
+#define VOL_INDEX_ARCHIVE_LEN 16
+#define VOL_INDEX_EMPTY 0xFFFF
+
+typedef struct vol_index_header_t
+{
+    uint32_t magic;
+    uint16_t num_archives;
+    uint16_t num_entries;
+    uint16_t num_buckets;
+    uint16_t num_slots;    //Power of two
+    uint32_t version;
+} vol_index_header_t;
+
+typedef struct vol_index_entry_t
+{
+    char name[VOL_INDEX_NAME_LEN]; //Upper case, NUL padded
+    uint32_t offset;
+    uint32_t size;        //Size once decompressed
+    uint32_t stored_size; //Size in the archive
+    uint8_t archive;
+    uint8_t flags;
+    uint8_t pad[2];
+} vol_index_entry_t;
+
+#define VOL_INDEX_FLAG_LZ (1 << 0)
+
+//Packed archives align every entry so it can be DMA'd straight out of the cart
+#define VOL_PACK_ALIGN 16
+
+//FNV-1a over the upper cased name and the archive number, with a murmur3 finaliser.
+//Shared by the tool and the runtime so both always agree.
+static inline uint32_t vol_index_hash(const char *name, uint8_t archive, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (int i = 0; i < VOL_INDEX_NAME_LEN && name[i] != '\0'; i++)
+    {
+        char c = name[i];
+        h ^= (uint8_t)((c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c);
+        h *= 16777619u;
+    }
+    h ^= archive;
+    h *= 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint32_t vol_index_slot(const char *name, uint8_t archive, uint16_t displacement, uint16_t num_slots)
+{
+    uint32_t h1 = vol_index_hash(name, archive, 1);
+    uint32_t h2 = vol_index_hash(name, archive, 2) | 1;
+    return (h1 + displacement * h2) & (num_slots - 1);
+}
+
+static inline uint32_t vol_index_bucket(const char *name, uint8_t archive, uint16_t num_buckets)
+{
+    return vol_index_hash(name, archive, 0) % num_buckets;
+}
+
+//Read only view of an archive entry, read straight from the memory mapped cartridge instead of through
+//DFS and a heap copy. Implemented in n64_vol.c. Only raw entries can be opened this way, compressed ones
+//have to be loaded with vol_file_load or vol_file_extract_by_name.
+typedef struct vol_rom_t
+{
+    uint32_t rom_addr; //Physical cart address of the entry
+    uint32_t size;
+} vol_rom_t;
+
+bool vol_rom_open(const char *vol_filename, const char *filename, vol_rom_t *rom);
+
+//Searches the archives in the same order as the game's open_file (episode VOL, then COSMO.STN)
+bool vol_rom_open_any(const char *filename, vol_rom_t *rom);
+
+//PI DMA len bytes at offset into dest. dest can have any alignment; the fast path is 8 byte aligned RAM.
+void vol_rom_read(const vol_rom_t *rom, uint32_t offset, void *dest, uint32_t len);
+
+//Single reads, served from a VOL_BLOCK_SIZE read ahead block. The game data is little endian.
+uint8_t vol_rom_read8(const vol_rom_t *rom, uint32_t offset);
+uint16_t vol_rom_read16(const vol_rom_t *rom, uint32_t offset);
+
+//Raw entries opened with vol_file_open and the single reads above fetch the cart a block at a time, aligned to
+//the block size. Anything that falls in the current block is a memcpy instead of a PI transaction.
+#ifndef VOL_BLOCK_SIZE
+#define VOL_BLOCK_SIZE 8192
+#endif
+
+#if (VOL_BLOCK_SIZE & (VOL_BLOCK_SIZE - 1)) != 0
+#error VOL_BLOCK_SIZE must be a power of two
+#endif
+
+//PI traffic from the vol layer, to compare against the number of reads the game asked for
+typedef struct vol_pi_stats_t
+{
+    uint32_t reads;  //vol_rom_read* calls and File reads of raw entries
+    uint32_t dmas;   //PI DMAs started
+    uint64_t bytes;  //Bytes moved by those DMAs
+} vol_pi_stats_t;
+
+void vol_get_pi_stats(vol_pi_stats_t *stats);
+void vol_reset_pi_stats(void);
+
+//Background loading of entries the game is going to ask for soon. Entries are read and decoded a chunk at a
+//time into a fixed staging pool, and the next vol_file_* call for one just copies it out. The pool is not on
+//the engine's heap, so staging never changes the engine's heap layout.
+//Without the Expansion Pak the pool is static and sized for the largest thing staged at once: the next level
+//map with its backdrop, or the two boot screens. With the Pak it is pinned in the resident cache instead and is
+//big enough for every map in the prefetch plan with its backdrop.
+#define VOL_PREFETCH_MAP_BYTES 0x12000     //64kB of tiles plus the actor list, the largest map is 68156 bytes
+#define VOL_PREFETCH_BACKDROP_BYTES 0x5A00 //Every backdrop is 23040 bytes
+#define VOL_PREFETCH_SCREEN_BYTES 64000    //Full screen 320x200 image, eg TITLE1.MNI
+#define VOL_PREFETCH_LEVEL_BYTES (VOL_PREFETCH_MAP_BYTES + VOL_PREFETCH_BACKDROP_BYTES)
+#ifndef VOL_PREFETCH_MAX_BYTES
+#define VOL_PREFETCH_MAX_BYTES \
+    ((VOL_PREFETCH_LEVEL_BYTES > 2 * VOL_PREFETCH_SCREEN_BYTES) ? VOL_PREFETCH_LEVEL_BYTES : 2 * VOL_PREFETCH_SCREEN_BYTES)
+#endif
+#define VOL_PREFETCH_MAX_ENTRIES 8
+#define VOL_PREFETCH_CACHED_BYTES (VOL_PREFETCH_MAX_ENTRIES / 2 * VOL_PREFETCH_LEVEL_BYTES)
+
+//Queue an entry, searching the archives like vol_rom_open_any. False if it is unknown or does not fit.
+bool vol_prefetch(const char *filename);
+
+//Same, for an entry of one particular archive
+bool vol_prefetch_from(const char *vol_filename, const char *filename);
+
+//Read and decode the next chunk of the queued entries. Returns false when there is nothing left to do.
+bool vol_prefetch_step(void);
+
+//Data of a fully staged entry, or NULL.
+const uint8_t *vol_prefetch_peek(const char *filename, uint32_t *size);
+
+//Drop everything that has been staged.
+void vol_prefetch_clear(void);
+
+//Called with the name of every entry the game loads
+void vol_set_load_hook(void (*hook)(const char *filename));
+
+//Print the load time of every asset. The DMA time of compressed entries is also scaled up to the raw size,
+//to compare against what loading it uncompressed would have cost.
+#ifndef VOL_LOAD_TIMINGS
+#define VOL_LOAD_TIMINGS 0
+#endif
+
+#endif
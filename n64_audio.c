@@ -2,17 +2,147 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #include <libdragon.h>
+#include <string.h>
 #include "sound/audio.h"
 #include "sound/music.h"
+#include "n64/n64_audio.h"
+#include "n64/regsinternal.h"
 
-#define AUDIO_DESIRED_SAMPLE_RATE 44100
 #define AUDIO_DESIRED_NUM_CHANNELS 2
 #define AUDIO_BYTES_PER_SAMPLE 2
-void sfx_close(void);
-void music_close(void);
+#define AUDIO_NUM_BUFFERS 4
+
+//Log the audio stats over ISViewer every this many ms. 0 disables the periodic log.
+#ifndef AUDIO_STATS_LOG_INTERVAL_MS
+#define AUDIO_STATS_LOG_INTERVAL_MS 0
+#endif
+
+#define AI_STATUS_BUSY (1 << 30)
+#define AI_STATUS_FULL (1 << 31)
 
 AudioConfig audioConfig;
 
+static const audio_profile_t audio_profiles[AUDIO_PROFILE_MAX] = {
+    [AUDIO_PROFILE_FULL] = {"full", 44100, 19200, 22050, AUDIO_MIXER_CHANNELS},
+    [AUDIO_PROFILE_LOW_COST] = {"low cost", 22050, 11025, 11025, AUDIO_MIXER_CHANNELS / 2},
+    [AUDIO_PROFILE_MATCHED] = {"matched", 22050, 22050, 22050, AUDIO_MIXER_CHANNELS},
+};
+static const audio_profile_t *const audio_profile = &audio_profiles[AUDIO_PROFILE];
+
+static volatile struct AI_regs_s * const AI_regs = (struct AI_regs_s *)0xa4500000;
+static audio_stats_t audio_stats;
+static uint32_t last_refill_ticks = 0;
+static timer_link_t *stats_timer = NULL;
+static volatile bool stats_log_due = false;
+
+void audio_stats_record(audio_stat_id_t id, uint32_t ticks)
+{
+    audio_cost_t *cost = &audio_stats.cost[id];
+    cost->calls++;
+    cost->ticks_total += ticks;
+    if (ticks > cost->ticks_max)
+    {
+        cost->ticks_max = ticks;
+    }
+}
+
+static void audio_stats_refill(uint32_t now)
+{
+    //The AI length register counts down the bytes left in the current DMA, and a second
+    //buffer may be queued behind it. libdragon has already handed the AI its next buffer by the time this
+    //runs, so normally that buffer is waiting behind the one playing. If it is not, the AI had run dry and
+    //the new buffer started straight away. The first refills are the AI filling up, not an underrun.
+    uint32_t status = AI_regs->status;
+    uint32_t queued = 0;
+    if (status & AI_STATUS_BUSY)
+    {
+        queued = AI_regs->length / (AUDIO_DESIRED_NUM_CHANNELS * AUDIO_BYTES_PER_SAMPLE);
+        if (status & AI_STATUS_FULL)
+        {
+            queued += audio_get_buffer_length();
+        }
+    }
+    if (!(status & AI_STATUS_FULL) && audio_stats.refills >= AUDIO_NUM_BUFFERS)
+    {
+        audio_stats.underruns++;
+    }
+
+    if (audio_stats.refills == 0 || queued < audio_stats.fill_min)
+    {
+        audio_stats.fill_min = queued;
+    }
+    audio_stats.fill_last = queued;
+
+    if (audio_stats.refills > 0 && now - last_refill_ticks > audio_stats.gap_max_ticks)
+    {
+        audio_stats.gap_max_ticks = now - last_refill_ticks;
+    }
+    last_refill_ticks = now;
+    audio_stats.refills++;
+}
+
+void audio_get_stats(audio_stats_t *stats)
+{
+    disable_interrupts();
+    *stats = audio_stats;
+    enable_interrupts();
+}
+
+void audio_reset_stats(void)
+{
+    disable_interrupts();
+    memset(&audio_stats, 0, sizeof(audio_stats));
+    enable_interrupts();
+}
+
+void audio_log_stats(void)
+{
+    static const char *names[AUDIO_STAT_MAX] = {"mixer", "music", "sfx"};
+    audio_stats_t stats;
+    audio_get_stats(&stats);
+
+    debugf("audio: refills %lu underruns %lu fill %lu/%lu min %lu samples, worst gap %lu us\n",
+           stats.refills, stats.underruns, stats.fill_last, (uint32_t)audio_get_buffer_length(), stats.fill_min,
+           (uint32_t)TICKS_TO_US(stats.gap_max_ticks));
+    for (int i = 0; i < AUDIO_STAT_MAX; i++)
+    {
+        audio_cost_t *cost = &stats.cost[i];
+        debugf("audio: %-5s calls %lu avg %lu us max %lu us\n", names[i], cost->calls,
+               cost->calls ? (uint32_t)TICKS_TO_US(cost->ticks_total / cost->calls) : 0,
+               (uint32_t)TICKS_TO_US(cost->ticks_max));
+    }
+}
+
+const audio_profile_t *audio_get_profile(void)
+{
+    return audio_profile;
+}
+
+//Runs in the timer interrupt, so only flag the log for audio_poll_stats
+static void audio_stats_timer(int ovfl)
+{
+    stats_log_due = true;
+}
+
+void audio_poll_stats(void)
+{
+    if (stats_log_due)
+    {
+        stats_log_due = false;
+        audio_log_stats();
+    }
+}
+
+//Called from the AI interrupt whenever a buffer has been consumed, so audio keeps
+//playing regardless of what the game loop is doing.
+static void audio_fill_buffer(short *buffer, size_t numsamples)
+{
+    uint32_t start = get_ticks();
+    audio_stats_refill(start);
+    mixer_poll(buffer, numsamples);
+    audio_stats_record(AUDIO_STAT_MIXER, get_ticks() - start);
+}
+
 void cosmo_audio_init()
 {
     if (audioConfig.enabled == true)
@@ -20,9 +150,16 @@ void cosmo_audio_init()
         return;
     }
 
-    audio_init(AUDIO_DESIRED_SAMPLE_RATE, 2);
-    mixer_init(16);  // Initialize up to 16 channels
+    debugf("audio: using %s profile\n", audio_profile->name);
+
+    audio_init(audio_profile->output_rate, AUDIO_NUM_BUFFERS);
+    mixer_init(audio_profile->mixer_channels);
+    audio_set_buffer_callback(audio_fill_buffer);
     timer_init();
+    if (AUDIO_STATS_LOG_INTERVAL_MS > 0)
+    {
+        stats_timer = new_timer(TIMER_TICKS(AUDIO_STATS_LOG_INTERVAL_MS * 1000), TF_CONTINUOUS, audio_stats_timer);
+    }
     audioConfig.format = AUDIO_INT16_SIGNED_LSB;
     audioConfig.enabled = true;
     music_init();
@@ -35,8 +172,14 @@ void audio_shutdown()
         return;
     }
 
+    if (stats_timer != NULL)
+    {
+        delete_timer(stats_timer);
+        stats_timer = NULL;
+    }
     sfx_close();
     music_close();
+    audio_set_buffer_callback(NULL);
     audio_close();
     audioConfig.enabled = false;
 }
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//game_init used to render every sfx before the first frame. Now load_sfx only reads the headers and the waves
+//are rendered here in the background, after the title and credit screens the main menu shows first are staged.
+
+#include <libdragon.h>
+#include "n64/n64_audio.h"
+#include "n64/n64_boot.h"
+#include "n64/n64_gfx.h"
+#include "n64/n64_idle.h"
+#include "n64/n64_vol.h"
+
+#ifdef EP3
+#define BOOT_TITLE_IMAGE "TITLE3.MNI"
+#elif EP2
+#define BOOT_TITLE_IMAGE "TITLE2.MNI"
+#else
+#define BOOT_TITLE_IMAGE "TITLE1.MNI"
+#endif
+
+typedef struct boot_stage_t
+{
+    const char *name;
+    idle_task_t step;
+} boot_stage_t;
+
+static bool boot_stage_menu(void);
+
+static const boot_stage_t boot_stages[] = {
+    {"menu images", boot_stage_menu},
+    {"sfx", sfx_load_step},
+};
+#define BOOT_NUM_STAGES (sizeof(boot_stages) / sizeof(boot_stages[0]))
+
+static uint32_t boot_main_ticks;
+static uint32_t boot_stage_ticks; //Time spent in the current stage so far
+static int boot_stage = BOOT_NUM_STAGES;
+static bool boot_menu_queued = false;
+static bool boot_frame_logged = false;
+
+//Queue the images, then read them in before letting the later stages have a turn
+static bool boot_stage_menu(void)
+{
+    if (!boot_menu_queued)
+    {
+        vol_prefetch_from(GFX_ARCHIVE, BOOT_TITLE_IMAGE);
+        vol_prefetch_from(GFX_ARCHIVE, "CREDIT.MNI");
+        boot_menu_queued = true;
+        return true;
+    }
+    return vol_prefetch_step();
+}
+
+static bool boot_task(void)
+{
+    if (boot_stage == BOOT_NUM_STAGES)
+    {
+        return false;
+    }
+
+    const boot_stage_t *stage = &boot_stages[boot_stage];
+    uint32_t start = get_ticks();
+    bool more = stage->step();
+    boot_stage_ticks += get_ticks() - start;
+    if (!more)
+    {
+        debugf("boot: %s loaded in %lluus of idle time, %lluus after main\n", stage->name,
+               (unsigned long long)TICKS_TO_US(boot_stage_ticks), (unsigned long long)TICKS_TO_US(get_ticks() - boot_main_ticks));
+        boot_stage++;
+        boot_stage_ticks = 0;
+    }
+    return true;
+}
+
+void boot_init(void)
+{
+    boot_main_ticks = get_ticks();
+}
+
+void boot_start(void)
+{
+    boot_stage = 0;
+    idle_add_task(boot_task);
+}
+
+void boot_finish(void)
+{
+    while (boot_task())
+        ;
+}
+
+void boot_frame_shown(void)
+{
+    if (boot_frame_logged)
+    {
+        return;
+    }
+    boot_frame_logged = true;
+    //The CPU count register starts counting at power on
+    uint32_t now = get_ticks();
+    debugf("boot: first frame %lluus after power on, %lluus after main\n", (unsigned long long)TICKS_TO_US(now),
+           (unsigned long long)TICKS_TO_US(now - boot_main_ticks));
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <stdio.h>
+#include <string.h>
+#include "n64/n64_cache.h"
+#include "n64/n64_mem.h"
+
+//Entries are kept sorted by their offset in the cache block. A new one goes in the first gap that is big enough,
+//and if there is none the least recently used entry is dropped and the gaps are searched again.
+typedef struct cache_entry_t
+{
+    char key[CACHE_KEY_LEN];
+    uint32_t offset;
+    uint32_t size;
+    uint32_t last_used;
+    bool pinned;
+} cache_entry_t;
+
+static uint8_t *cache_data = NULL;
+static cache_entry_t cache_entries[CACHE_MAX_ENTRIES];
+static int cache_num_entries = 0;
+static uint32_t cache_clock = 0;
+
+static uint32_t cache_align(uint32_t size)
+{
+    return (size + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+}
+
+void cache_init(void)
+{
+    if (cache_data != NULL)
+    {
+        return;
+    }
+    if (!is_memory_expanded())
+    {
+        debugf("cache: no Expansion Pak, assets are streamed\n");
+        return;
+    }
+    cache_data = mem_memalign(MEM_TAG_CACHE, CACHE_ALIGN, CACHE_SIZE);
+    assert(cache_data != NULL);
+    debugf("cache: Expansion Pak found, %lu bytes set aside for resident assets\n", (unsigned long)CACHE_SIZE);
+}
+
+bool cache_enabled(void)
+{
+    return cache_data != NULL;
+}
+
+void cache_make_key(char *key, const char *archive, const char *name)
+{
+    snprintf(key, CACHE_KEY_LEN, "%.16s/%.12s", archive, name);
+}
+
+static cache_entry_t *cache_find(const char *key)
+{
+    for (int i = 0; i < cache_num_entries; i++)
+    {
+        if (strncmp(cache_entries[i].key, key, CACHE_KEY_LEN) == 0)
+        {
+            return &cache_entries[i];
+        }
+    }
+    return NULL;
+}
+
+const void *cache_get(const char *key, uint32_t *size)
+{
+    cache_entry_t *entry = cache_enabled() ? cache_find(key) : NULL;
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+    entry->last_used = ++cache_clock;
+    *size = entry->size;
+    return &cache_data[entry->offset];
+}
+
+static void cache_remove(int index)
+{
+    memmove(&cache_entries[index], &cache_entries[index + 1], (cache_num_entries - index - 1) * sizeof(cache_entry_t));
+    cache_num_entries--;
+}
+
+static bool cache_evict(void)
+{
+    int lru = -1;
+    for (int i = 0; i < cache_num_entries; i++)
+    {
+        if (!cache_entries[i].pinned && (lru < 0 || cache_entries[i].last_used < cache_entries[lru].last_used))
+        {
+            lru = i;
+        }
+    }
+    if (lru < 0)
+    {
+        return false;
+    }
+    cache_remove(lru);
+    return true;
+}
+
+//Index to insert at, so the entries stay in offset order, or -1 if no gap fits
+static int cache_find_gap(uint32_t size, uint32_t *offset)
+{
+    uint32_t start = 0;
+    for (int i = 0; i <= cache_num_entries; i++)
+    {
+        uint32_t end = (i < cache_num_entries) ? cache_entries[i].offset : CACHE_SIZE;
+        if (end - start >= size)
+        {
+            *offset = start;
+            return i;
+        }
+        if (i < cache_num_entries)
+        {
+            start = cache_entries[i].offset + cache_align(cache_entries[i].size);
+        }
+    }
+    return -1;
+}
+
+void *cache_put(const char *key, uint32_t size)
+{
+    if (!cache_enabled() || cache_align(size) > CACHE_SIZE)
+    {
+        return NULL;
+    }
+
+    cache_entry_t *existing = cache_find(key);
+    if (existing != NULL)
+    {
+        if (existing->pinned)
+        {
+            return NULL;
+        }
+        cache_remove(existing - cache_entries);
+    }
+
+    uint32_t offset;
+    int index;
+    while ((index = cache_find_gap(cache_align(size), &offset)) < 0 || cache_num_entries == CACHE_MAX_ENTRIES)
+    {
+        if (!cache_evict())
+        {
+            return NULL;
+        }
+    }
+
+    memmove(&cache_entries[index + 1], &cache_entries[index], (cache_num_entries - index) * sizeof(cache_entry_t));
+    cache_num_entries++;
+    cache_entry_t *entry = &cache_entries[index];
+    memset(entry->key, 0, CACHE_KEY_LEN);
+    strncpy(entry->key, key, CACHE_KEY_LEN - 1);
+    entry->offset = offset;
+    entry->size = size;
+    entry->last_used = ++cache_clock;
+    entry->pinned = false;
+    return &cache_data[offset];
+}
+
+void cache_pin(const void *data, bool pinned)
+{
+    for (int i = 0; i < cache_num_entries && data != NULL; i++)
+    {
+        if (&cache_data[cache_entries[i].offset] == data)
+        {
+            cache_entries[i].pinned = pinned;
+            return;
+        }
+    }
+}
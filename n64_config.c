@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <stdio.h>
+#include "n64/n64_config.h"
+#include "n64/n64_sched.h"
+
+#define N64_CONFIG_MAGIC 0x4E363443 //N64C
+#define N64_CONFIG_VERSION 3
+
+#ifdef EP3
+#define N64_CONFIG_FILENAME "sram:/COSMO3.N64"
+#elif EP2
+#define N64_CONFIG_FILENAME "sram:/COSMO2.N64"
+#else
+#define N64_CONFIG_FILENAME "sram:/COSMO1.N64"
+#endif
+
+n64_config_t n64_config = {
+    .game_interval = COSMO_INTERVAL_DEFAULT,
+};
+
+static bool n64_config_dirty = false;
+
+void n64_config_load(void)
+{
+    FILE *fp = fopen(N64_CONFIG_FILENAME, "rb");
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    uint32_t magic = 0;
+    uint8_t version = 0;
+    fread(&magic, sizeof(magic), 1, fp);
+    fread(&version, sizeof(version), 1, fp);
+    //Versions 1 and 2 start with an audio profile byte, the profile is now fixed at build time so it is skipped.
+    //Version 1 files have nothing else, so everything keeps its default.
+    if (magic != N64_CONFIG_MAGIC || version < 1 || version > N64_CONFIG_VERSION)
+    {
+        debugf("n64_config: ignoring invalid config file\n");
+        fclose(fp);
+        return;
+    }
+
+    n64_config_t config = n64_config;
+    if (version < 3)
+    {
+        uint8_t audio_profile;
+        fread(&audio_profile, sizeof(audio_profile), 1, fp);
+    }
+    if (version >= 2)
+    {
+        fread(&config.game_interval, sizeof(config.game_interval), 1, fp);
+    }
+    fclose(fp);
+
+    if (config.game_interval < SCHED_INTERVAL_MIN || config.game_interval > SCHED_INTERVAL_MAX)
+    {
+        config.game_interval = COSMO_INTERVAL_DEFAULT;
+    }
+    n64_config = config;
+}
+
+void n64_config_save(void)
+{
+    FILE *fp = fopen(N64_CONFIG_FILENAME, "wb");
+    if (fp == NULL)
+    {
+        debugf("n64_config: could not open %s\n", N64_CONFIG_FILENAME);
+        return;
+    }
+
+    uint32_t magic = N64_CONFIG_MAGIC;
+    uint8_t version = N64_CONFIG_VERSION;
+    fwrite(&magic, sizeof(magic), 1, fp);
+    fwrite(&version, sizeof(version), 1, fp);
+    fwrite(&n64_config.game_interval, sizeof(n64_config.game_interval), 1, fp);
+    fclose(fp);
+    n64_config_dirty = false;
+}
+
+void n64_config_changed(void)
+{
+    n64_config_dirty = true;
+}
+
+void n64_config_flush(void)
+{
+    if (n64_config_dirty)
+    {
+        n64_config_save();
+    }
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Loads the tilesets and fullscreen images that tools/mkgfx converted at build time, straight from the ROM into
+//the buffer the game keeps. The engine's load_tiles and load_image are wrapped when the engine is partially
+//linked (see the Makefile); anything that is not in GFX.VOL still goes through the engine's own converters.
+
+#include <libdragon.h>
+#include <string.h>
+#include "tile.h"
+#include "files/vol.h"
+#include "n64/n64_gfx.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_quicksave.h"
+
+Tile *__real_load_tiles(const char *filename, TileType type, uint16 *num_tiles_loaded);
+uint8 *__real_load_image(const char *filename);
+
+#if GFX_VERIFY
+static void gfx_verify(const char *filename, const void *converted, const void *original, uint32_t size,
+                       uint32_t prebuilt_ticks, uint32_t engine_ticks)
+{
+    bool same = original != NULL && memcmp(converted, original, size) == 0;
+    debugf("gfx: %s %s, prebuilt %lluus, engine conversion %lluus\n", filename, same ? "matches" : "DIFFERS",
+           (unsigned long long)TICKS_TO_US(prebuilt_ticks), (unsigned long long)TICKS_TO_US(engine_ticks));
+}
+#endif
+
+Tile *__wrap_load_tiles(const char *filename, TileType type, uint16 *num_tiles_loaded)
+{
+    uint32_t start = get_ticks();
+    uint32 size = 0;
+    Tile *tiles = NULL;
+    if (sizeof(Tile) == GFX_TILE_SIZE)
+    {
+        tiles = (Tile *)vol_file_extract_by_name(GFX_ARCHIVE, filename, &size);
+    }
+
+    //Converted with a different type than the game asks for, let the game do it
+    if (tiles == NULL || size < GFX_TILE_SIZE || tiles[0].type != type)
+    {
+        mem_free(MEM_TAG_MISC, tiles);
+        return __real_load_tiles(filename, type, num_tiles_loaded);
+    }
+    *num_tiles_loaded = size / GFX_TILE_SIZE;
+
+#if GFX_VERIFY
+    uint32_t ticks = get_ticks() - start;
+    uint16 num_original = 0;
+    start = get_ticks();
+    Tile *original = __real_load_tiles(filename, type, &num_original);
+    gfx_verify(filename, tiles, (num_original == *num_tiles_loaded) ? original : NULL, size, ticks, get_ticks() - start);
+    if (num_original != *num_tiles_loaded)
+    {
+        debugf("gfx: %s has %u tiles, the game expects %u\n", filename, *num_tiles_loaded, num_original);
+    }
+    quicksave_untrack(original);
+    mem_free(MEM_TAG_MISC, original);
+#else
+    (void)start;
+#endif
+    quicksave_track_asset(tiles, size);
+    return tiles;
+}
+
+uint8 *__wrap_load_image(const char *filename)
+{
+    uint32_t start = get_ticks();
+    uint32 size = 0;
+    uint8 *pixels = vol_file_extract_by_name(GFX_ARCHIVE, filename, &size);
+    if (pixels == NULL || size != GFX_IMAGE_SIZE)
+    {
+        mem_free(MEM_TAG_MISC, pixels);
+        return __real_load_image(filename);
+    }
+
+#if GFX_VERIFY
+    uint32_t ticks = get_ticks() - start;
+    start = get_ticks();
+    uint8 *original = __real_load_image(filename);
+    gfx_verify(filename, pixels, original, GFX_IMAGE_SIZE, ticks, get_ticks() - start);
+    quicksave_untrack(original);
+    mem_free(MEM_TAG_MISC, original);
+#else
+    (void)start;
+#endif
+    quicksave_track_asset(pixels, size);
+    return pixels;
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include "n64/n64_idle.h"
+
+static idle_task_t idle_tasks[IDLE_MAX_TASKS];
+static int idle_num_tasks = 0;
+static int idle_next = 0;
+static bool idle_running = false;
+
+void idle_add_task(idle_task_t task)
+{
+    assert(idle_num_tasks < IDLE_MAX_TASKS);
+    idle_tasks[idle_num_tasks++] = task;
+}
+
+void idle_run(uint64_t deadline)
+{
+    //Tasks can end up waiting themselves, don't nest
+    if (idle_running || idle_num_tasks == 0)
+    {
+        return;
+    }
+    idle_running = true;
+
+    //Round robin so one busy task cannot starve the others. Stop after a full round with nothing to do.
+    int idle_count = 0;
+    while (idle_count < idle_num_tasks && timer_ticks() + TIMER_TICKS(IDLE_SLICE_US) < deadline)
+    {
+        idle_task_t task = idle_tasks[idle_next];
+        idle_next = (idle_next + 1) % idle_num_tasks;
+        idle_count = task() ? 0 : idle_count + 1;
+    }
+    idle_running = false;
+}
@@ -5,6 +5,15 @@
 #include "input.h"
 #include "dialog.h"
 #include "demo.h"
+#include "n64/n64_quicksave.h"
+#include "n64/n64_idle.h"
+#include "n64/n64_sched.h"
+#include "n64/n64_pad.h"
+#include "n64/n64_latency.h"
+#include "n64/n64_config.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_prefetch.h"
+#include "n64/n64_audio.h"
 
 SDL_Keycode cfg_up_key = SDLK_UP;
 SDL_Keycode cfg_down_key = SDLK_DOWN;
@@ -30,6 +39,8 @@ uint8 byte_2E17C;
 bool input_init()
 {
     controller_init();
+    pad_init();
+    latency_init();
     reset_player_control_inputs();
     return true;
 }
@@ -40,36 +51,54 @@ void input_shutdown()
 
 void wait_for_time_or_key(int delay_in_game_cycles)
 {
-    struct controller_data keys;
+    pad_input_t input;
     reset_player_control_inputs();
 
+    //Only a press from now on ends the wait. Presses queued from before are flushed, and a button still held
+    //from before does not count until it is released and pressed again.
+    sched_resync();
+    pad_flush();
     uint32_t timeout = get_ticks_ms() + (8 * delay_in_game_cycles);
     while (get_ticks_ms() < timeout)
     {
-        controller_scan();
-        keys = get_keys_pressed();
-        if (keys.c->data & 0xFFFFFF00)
+        //Keep each slice of background work short so a key press is still picked up straight away
+        idle_run(timer_ticks() + TIMER_TICKS(IDLE_SLICE_US * 2));
+        //Presses are queued as they are sampled, so a tap during the idle work is not missed
+        pad_read(&input);
+        if (input.down.c[0].data & PAD_BUTTONS_MASK)
         {
             return;
         }
     }
 }
 
+static SDL_Keycode input_poll_key(void);
+
 input_state_enum read_input()
 {
+    //The first input poll of a level means it has finished loading
+    if (prefetch_level_started())
+    {
+        n64_config_flush();
+        sched_resync();
+    }
+    sched_tick();
+    audio_poll_stats();
+
     if(game_play_mode == PLAY_DEMO)
     {
-        if(poll_for_key_press(false) != SDLK_UNKNOWN || read_input_from_demo())
+        if(input_poll_key() != SDLK_UNKNOWN || read_input_from_demo())
         {
             return QUIT;
         }
         return CONTINUE;
     }
 
-    controller_scan();
-    struct controller_data keys;
-
-    keys = get_keys_pressed();
+    //Buttons tapped and released since the last tick count as held for this one
+    pad_input_t input;
+    pad_read(&input);
+    latency_tick(input.first_press_ticks);
+    struct controller_data keys = input.held;
     if(keys.c[0].err) return CONTINUE;
     if (keys.c[0].L && keys.c[0].R) return QUIT;
 
@@ -87,9 +116,36 @@ input_state_enum read_input()
     if (keys.c[0].y >  20) input_up_key_pressed = 1;
     if (keys.c[0].y < -20) down_key_pressed = 1;
 
-    keys = get_keys_down();
+    keys = input.down;
+    if (keys.c[0].C_left)
+    {
+        quicksave_save();
+        sched_resync();
+    }
+    if (keys.c[0].C_right && quicksave_load())
+    {
+        reset_player_control_inputs();
+        sched_resync();
+        return CONTINUE;
+    }
+    if (keys.c[0].Z)
+    {
+        mem_report("requested");
+    }
+    if (keys.c[0].C_up || keys.c[0].C_down)
+    {
+        //C-up speeds the game up, C-down slows it down. The speed is kept in the port config, which is written
+        //at the next pause or level load rather than mid game.
+        uint32_t interval = sched_game_interval();
+        sched_set_game_interval(keys.c[0].C_up ? interval - SCHED_INTERVAL_STEP : interval + SCHED_INTERVAL_STEP);
+        n64_config.game_interval = sched_game_interval();
+        n64_config_changed();
+        debugf("sched: game tick interval %lu ms\n", sched_game_interval());
+    }
     if (keys.c[0].start)
     {
+        sched_resync();
+        n64_config_flush();
         switch(help_menu_dialog())
         {
             case 0 : break;
@@ -112,10 +168,11 @@ void reset_player_control_inputs()
     jump_key_pressed = 0;
 }
 
-SDL_Keycode poll_for_key_press(bool allow_key_repeat)
+static SDL_Keycode input_poll_key(void)
 {
-    controller_scan();
-    struct controller_data keys = get_keys_down();
+    pad_input_t input;
+    pad_read(&input);
+    struct controller_data keys = input.down;
     if (keys.c[0].err)
     {
         return SDLK_UNKNOWN;
@@ -137,9 +194,16 @@ SDL_Keycode poll_for_key_press(bool allow_key_repeat)
     return SDLK_UNKNOWN;
 }
 
+//The engine only polls like this from its menus and dialogs, which hold up the game
+SDL_Keycode poll_for_key_press(bool allow_key_repeat)
+{
+    sched_resync();
+    return input_poll_key();
+}
+
 void cosmo_wait(int delay)
 {
-    SDL_Delay(8 * delay);
+    sched_wait(8 * delay);
 }
 
 void set_input_command_key(InputCommand command, SDL_Keycode keycode)
@@ -182,7 +246,7 @@ const char *get_command_key_string(InputCommand command)
 
 void flush_input()
 {
-    controller_scan();
+    pad_flush();
 }
 
 bool is_return_key(SDL_Keycode key)
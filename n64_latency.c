@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <stdio.h>
+#include <string.h>
+#include "n64/n64_latency.h"
+
+#if INPUT_LATENCY_STATS
+
+typedef enum
+{
+    LATENCY_IDLE,
+    LATENCY_CONSUMED,
+    LATENCY_SUBMITTED
+} latency_state_t;
+
+typedef struct latency_hist_t
+{
+    uint32_t buckets[LATENCY_NUM_BUCKETS]; //The last bucket also counts everything above it
+    uint64_t ticks_total;
+    uint64_t ticks_max;
+} latency_hist_t;
+
+//One press is followed at a time. Presses read while it is still on its way to the screen are not sampled.
+static volatile latency_state_t latency_state = LATENCY_IDLE;
+static uint64_t latency_stamp[LATENCY_STAGE_MAX];
+static uint32_t latency_consumed_tick = 0;
+static uint32_t latency_game_ticks = 0;
+
+static latency_hist_t latency_hist[LATENCY_STAGE_MAX];
+static uint32_t latency_samples = 0;
+static uint32_t latency_logged = 0;
+static uint32_t latency_ticks_late = 0;
+static uint32_t latency_ticks_late_max = 0;
+
+static void latency_record(latency_stage_t stage, uint64_t ticks)
+{
+    latency_hist_t *hist = &latency_hist[stage];
+    uint32_t bucket = TICKS_TO_US(ticks) / LATENCY_BUCKET_US;
+    hist->buckets[(bucket < LATENCY_NUM_BUCKETS) ? bucket : LATENCY_NUM_BUCKETS - 1]++;
+    hist->ticks_total += ticks;
+    if (ticks > hist->ticks_max)
+    {
+        hist->ticks_max = ticks;
+    }
+}
+
+//The VI picks up a finished framebuffer on the next vblank. If the RDP is still drawing then, the frame goes out one
+//vblank later than recorded here.
+static void latency_vi_interrupt(void)
+{
+    if (latency_state != LATENCY_SUBMITTED)
+    {
+        return;
+    }
+    uint64_t now = timer_ticks();
+    latency_record(LATENCY_SCANOUT, now - latency_stamp[LATENCY_SCANOUT]);
+    latency_record(LATENCY_TOTAL, now - latency_stamp[LATENCY_QUEUE]);
+    latency_samples++;
+    latency_state = LATENCY_IDLE;
+}
+
+void latency_init(void)
+{
+    memset(latency_hist, 0, sizeof(latency_hist));
+    register_VI_handler(latency_vi_interrupt);
+}
+
+void latency_tick(uint64_t press_ticks)
+{
+    latency_game_ticks++;
+    if (latency_samples - latency_logged >= LATENCY_LOG_EVERY)
+    {
+        latency_logged = latency_samples;
+        latency_log();
+    }
+    if (press_ticks == 0 || latency_state != LATENCY_IDLE)
+    {
+        return;
+    }
+    latency_stamp[LATENCY_QUEUE] = press_ticks;
+    latency_stamp[LATENCY_TICK] = timer_ticks();
+    latency_consumed_tick = latency_game_ticks;
+    latency_state = LATENCY_CONSUMED;
+}
+
+void latency_frame_begin(void)
+{
+    if (latency_state == LATENCY_CONSUMED)
+    {
+        latency_stamp[LATENCY_PRESENT] = timer_ticks();
+    }
+}
+
+void latency_frame_locked(void)
+{
+    if (latency_state == LATENCY_CONSUMED)
+    {
+        latency_stamp[LATENCY_RENDER] = timer_ticks();
+    }
+}
+
+void latency_frame_submitted(void)
+{
+    if (latency_state != LATENCY_CONSUMED)
+    {
+        return;
+    }
+    disable_interrupts();
+    latency_stamp[LATENCY_SCANOUT] = timer_ticks();
+    for (int stage = LATENCY_QUEUE; stage < LATENCY_SCANOUT; stage++)
+    {
+        latency_record(stage, latency_stamp[stage + 1] - latency_stamp[stage]);
+    }
+
+    //More than one tick ran before this frame, so the press was drawn late
+    uint32_t late = latency_game_ticks - latency_consumed_tick;
+    if (late > 0)
+    {
+        latency_ticks_late++;
+    }
+    if (late > latency_ticks_late_max)
+    {
+        latency_ticks_late_max = late;
+    }
+    latency_state = LATENCY_SUBMITTED;
+    enable_interrupts();
+}
+
+void latency_log(void)
+{
+    static const char *names[LATENCY_STAGE_MAX] = {"queue", "tick", "present", "render", "scanout", "total"};
+    latency_hist_t hist[LATENCY_STAGE_MAX];
+    disable_interrupts();
+    memcpy(hist, latency_hist, sizeof(hist));
+    uint32_t samples = latency_samples;
+    enable_interrupts();
+    if (samples == 0)
+    {
+        return;
+    }
+
+    debugf("latency: %lu presses, %lu shown after a later tick (worst %lu ticks), buckets of %u us\n", samples,
+           latency_ticks_late, latency_ticks_late_max, LATENCY_BUCKET_US);
+    for (int stage = 0; stage < LATENCY_STAGE_MAX; stage++)
+    {
+        char line[LATENCY_NUM_BUCKETS * 6 + 1];
+        int len = 0;
+        for (int i = 0; i < LATENCY_NUM_BUCKETS && len < (int)sizeof(line); i++)
+        {
+            len += snprintf(&line[len], sizeof(line) - len, " %lu", hist[stage].buckets[i]);
+        }
+        debugf("latency: %-7s avg %6lu us max %6lu us |%s\n", names[stage],
+               (uint32_t)TICKS_TO_US(hist[stage].ticks_total / samples), (uint32_t)TICKS_TO_US(hist[stage].ticks_max),
+               line);
+    }
+}
+
+#endif
@@ -0,0 +1,327 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <string.h>
+#include "n64/n64_lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 //The format requires the last 5 bytes to be literals
+#define LZ_MAX_OFFSET 0xFFFF
+#define LZ_HASH_BITS 12
+#define LZ_NO_MATCH 0xFFFFFFFF
+
+static uint32_t lz_hash_table[1 << LZ_HASH_BITS];
+
+static uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+//Writes the 255 run extension of a length field. Returns the new output position, or 0 if out of space.
+static uint32_t lz_put_length(uint8_t *dst, uint32_t op, uint32_t dst_max, uint32_t len)
+{
+    while (len >= 255)
+    {
+        if (op >= dst_max)
+        {
+            return 0;
+        }
+        dst[op++] = 255;
+        len -= 255;
+    }
+    if (op >= dst_max)
+    {
+        return 0;
+    }
+    dst[op++] = len;
+    return op;
+}
+
+static uint32_t lz_put_sequence(uint8_t *dst, uint32_t op, uint32_t dst_max,
+                                const uint8_t *literals, uint32_t lit_len, uint32_t offset, uint32_t match_len)
+{
+    if (op >= dst_max)
+    {
+        return 0;
+    }
+    uint32_t token_pos = op++;
+    uint8_t token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15 && (op = lz_put_length(dst, op, dst_max, lit_len - 15)) == 0)
+    {
+        return 0;
+    }
+    if (op + lit_len > dst_max)
+    {
+        return 0;
+    }
+    memcpy(&dst[op], literals, lit_len);
+    op += lit_len;
+
+    //Last sequence is literals only
+    if (match_len == 0)
+    {
+        dst[token_pos] = token;
+        return op;
+    }
+
+    if (op + 2 > dst_max)
+    {
+        return 0;
+    }
+    dst[op++] = offset & 0xFF;
+    dst[op++] = offset >> 8;
+    match_len -= LZ_MIN_MATCH;
+    token |= (match_len >= 15) ? 15 : match_len;
+    if (match_len >= 15 && (op = lz_put_length(dst, op, dst_max, match_len - 15)) == 0)
+    {
+        return 0;
+    }
+    dst[token_pos] = token;
+    return op;
+}
+
+uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_max)
+{
+    uint32_t ip = 0, anchor = 0, op = 0;
+    memset(lz_hash_table, 0xFF, sizeof(lz_hash_table));
+
+    if (len > LZ_MIN_MATCH + LZ_LAST_LITERALS)
+    {
+        uint32_t match_limit = len - LZ_LAST_LITERALS;
+        while (ip + LZ_MIN_MATCH <= match_limit)
+        {
+            uint32_t seq = lz_read32(&src[ip]);
+            uint32_t h = lz_hash(seq);
+            uint32_t ref = lz_hash_table[h];
+            lz_hash_table[h] = ip;
+
+            if (ref == LZ_NO_MATCH || ip - ref > LZ_MAX_OFFSET || lz_read32(&src[ref]) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            uint32_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < match_limit && src[ref + match_len] == src[ip + match_len])
+            {
+                match_len++;
+            }
+
+            op = lz_put_sequence(dst, op, dst_max, &src[anchor], ip - anchor, ip - ref, match_len);
+            if (op == 0)
+            {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = lz_put_sequence(dst, op, dst_max, &src[anchor], len - anchor, 0, 0);
+    return op;
+}
+
+uint32_t lz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+    uint32_t ip = 0, op = 0;
+    while (ip < src_len)
+    {
+        uint8_t token = src[ip++];
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= src_len)
+                {
+                    return 0;
+                }
+                b = src[ip++];
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (ip + lit_len > src_len || op + lit_len > dst_len)
+        {
+            return 0;
+        }
+        memcpy(&dst[op], &src[ip], lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        //End of block
+        if (ip == src_len)
+        {
+            break;
+        }
+
+        if (ip + 2 > src_len)
+        {
+            return 0;
+        }
+        uint32_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+        {
+            return 0;
+        }
+
+        uint32_t match_len = token & 0x0F;
+        if (match_len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= src_len)
+                {
+                    return 0;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if (op + match_len > dst_len)
+        {
+            return 0;
+        }
+
+        //Matches can overlap their own output, which repeats the last offset bytes
+        uint8_t *out = &dst[op];
+        const uint8_t *ref = out - offset;
+        if (offset >= match_len)
+        {
+            memcpy(out, ref, match_len);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < match_len; i++)
+            {
+                out[i] = ref[i];
+            }
+        }
+        op += match_len;
+    }
+    return op;
+}
+
+enum
+{
+    LZ_STATE_TOKEN,
+    LZ_STATE_LITERAL_LENGTH,
+    LZ_STATE_LITERALS,
+    LZ_STATE_OFFSET_LO,
+    LZ_STATE_OFFSET_HI,
+    LZ_STATE_MATCH_LENGTH,
+};
+
+void lz_stream_init(lz_stream_t *s, uint8_t *dst, uint32_t dst_len)
+{
+    memset(s, 0, sizeof(*s));
+    s->dst = dst;
+    s->dst_len = dst_len;
+    s->state = LZ_STATE_TOKEN;
+}
+
+static bool lz_stream_match(lz_stream_t *s)
+{
+    uint32_t match_len = s->len + LZ_MIN_MATCH;
+    if (s->offset == 0 || s->offset > s->op || s->op + match_len > s->dst_len)
+    {
+        return false;
+    }
+    uint8_t *out = &s->dst[s->op];
+    const uint8_t *ref = out - s->offset;
+    if (s->offset >= match_len)
+    {
+        memcpy(out, ref, match_len);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < match_len; i++)
+        {
+            out[i] = ref[i];
+        }
+    }
+    s->op += match_len;
+    s->state = LZ_STATE_TOKEN;
+    return true;
+}
+
+bool lz_stream_feed(lz_stream_t *s, const uint8_t *src, uint32_t len)
+{
+    uint32_t ip = 0;
+    while (ip < len)
+    {
+        switch (s->state)
+        {
+        case LZ_STATE_TOKEN:
+            s->token = src[ip++];
+            s->len = s->token >> 4;
+            s->state = (s->len == 15) ? LZ_STATE_LITERAL_LENGTH : LZ_STATE_LITERALS;
+            break;
+        case LZ_STATE_LITERAL_LENGTH:
+            s->len += src[ip];
+            if (src[ip++] != 255)
+            {
+                s->state = LZ_STATE_LITERALS;
+            }
+            break;
+        case LZ_STATE_LITERALS:
+        {
+            uint32_t n = len - ip;
+            n = (n < s->len) ? n : s->len;
+            if (s->op + n > s->dst_len)
+            {
+                return false;
+            }
+            memcpy(&s->dst[s->op], &src[ip], n);
+            s->op += n;
+            ip += n;
+            s->len -= n;
+            if (s->len == 0)
+            {
+                s->state = LZ_STATE_OFFSET_LO;
+            }
+            break;
+        }
+        case LZ_STATE_OFFSET_LO:
+            s->offset = src[ip++];
+            s->state = LZ_STATE_OFFSET_HI;
+            break;
+        case LZ_STATE_OFFSET_HI:
+            s->offset |= src[ip++] << 8;
+            s->len = s->token & 0x0F;
+            if (s->len == 15)
+            {
+                s->state = LZ_STATE_MATCH_LENGTH;
+            }
+            else if (!lz_stream_match(s))
+            {
+                return false;
+            }
+            break;
+        case LZ_STATE_MATCH_LENGTH:
+            s->len += src[ip];
+            if (src[ip++] != 255 && !lz_stream_match(s))
+            {
+                return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+bool lz_stream_done(const lz_stream_t *s)
+{
+    //A block ends straight after the literals of its last sequence
+    return s->op == s->dst_len && (s->state == LZ_STATE_OFFSET_LO || (s->state == LZ_STATE_TOKEN && s->op == 0));
+}
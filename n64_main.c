@@ -14,6 +14,12 @@
 #include "demo.h"
 #include "b800.h"
 #include "input.h"
+#include "n64/n64_config.h"
+#include "n64/n64_prefetch.h"
+#include "n64/n64_boot.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_cache.h"
+#include "n64/n64_sched.h"
 
 extern char *save_directory;
 void cosmo_audio_init();
@@ -27,7 +33,7 @@ typedef struct sram_files_t
 } sram_files_t;
 int sramfs_init(sram_files_t *files, int num_files);
 
-#define MAX_SRAM_FILES 10
+#define MAX_SRAM_FILES 11
 #ifdef EP3
 static sram_files_t sram_files[MAX_SRAM_FILES] = {
     {"COSMO3.CFG", 256, 0},
@@ -40,6 +46,7 @@ static sram_files_t sram_files[MAX_SRAM_FILES] = {
     {"COSMO3.SV7", 128, 0},
     {"COSMO3.SV8", 128, 0},
     {"COSMO3.SV9", 128, 0},
+    {"COSMO3.N64", 64, 0},
 };
 #elif EP2
 static sram_files_t sram_files[MAX_SRAM_FILES] = {
@@ -53,6 +60,7 @@ static sram_files_t sram_files[MAX_SRAM_FILES] = {
     {"COSMO2.SV7", 128, 0},
     {"COSMO2.SV8", 128, 0},
     {"COSMO2.SV9", 128, 0},
+    {"COSMO2.N64", 64, 0},
 };
 #else
 static sram_files_t sram_files[MAX_SRAM_FILES] = {
@@ -66,19 +74,25 @@ static sram_files_t sram_files[MAX_SRAM_FILES] = {
     {"COSMO1.SV7", 128, 0},
     {"COSMO1.SV8", 128, 0},
     {"COSMO1.SV9", 128, 0},
+    {"COSMO1.N64", 64, 0},
 };
 #endif
 
 int main(void)
 {
     debug_init(DEBUG_FEATURE_LOG_ISVIEWER);
+    boot_init();
     dfs_init(DFS_DEFAULT_LOCATION);
+    cache_init();
 
-    save_directory = malloc(32);
+    save_directory = mem_alloc(MEM_TAG_MISC, 32);
     strcpy(save_directory, "sram:/");
     load_config_from_command_line(0, NULL);
 
     sramfs_init(sram_files, MAX_SRAM_FILES);
+    n64_config_load();
+    sched_set_game_interval(n64_config.game_interval);
+    prefetch_init();
 
     #ifdef EP3
 	set_episode_number(3);
@@ -90,8 +104,10 @@ int main(void)
 
     video_init();
     cosmo_audio_init();
+    sched_init();
     input_init();
     game_init();
+    boot_start();
 
     video_fill_screen_with_black();
 
@@ -106,6 +122,9 @@ int main(void)
         game_play_mode = PLAY_GAME;
     }
 
+    //Anything the background stages did not get to is done now, before the first level needs it
+    boot_finish();
+
     while (game_play_mode != QUIT_GAME)
     {
         load_level(current_level);
@@ -117,6 +136,7 @@ int main(void)
 
         game_loop();
         stop_music();
+        n64_config_flush();
         if (game_play_mode == PLAY_GAME)
         {
             show_high_scores();
@@ -133,6 +153,7 @@ int main(void)
 int cleanup_and_exit()
 {
     write_config_file();
+    n64_config_save();
     config_cleanup();
     video_shutdown();
     audio_shutdown();
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "n64/n64_mem.h"
+#include "n64/n64_vol.h"
+
+static mem_tag_stats_t mem_stats[MEM_TAG_MAX];
+
+static const char *mem_tag_names[MEM_TAG_MAX] = {
+    [MEM_TAG_VIDEO] = "video",
+    [MEM_TAG_AUDIO] = "audio",
+    [MEM_TAG_SAVE] = "save",
+    [MEM_TAG_CACHE] = "cache",
+    [MEM_TAG_MISC] = "misc",
+};
+
+static void mem_record(mem_tag_t tag, int32_t bytes, int32_t allocations)
+{
+    assert(tag < MEM_TAG_MAX);
+    mem_tag_stats_t *stats = &mem_stats[tag];
+    stats->bytes += bytes;
+    stats->allocations += allocations;
+    if (allocations > 0)
+    {
+        stats->total += allocations;
+    }
+    if (stats->bytes > stats->peak)
+    {
+        stats->peak = stats->bytes;
+    }
+}
+
+//Sizes are what the allocator actually set aside, so they add up to the heap's own figures
+static void *mem_track(mem_tag_t tag, void *ptr)
+{
+    if (ptr != NULL)
+    {
+        mem_record(tag, malloc_usable_size(ptr), 1);
+    }
+    return ptr;
+}
+
+void *mem_alloc(mem_tag_t tag, size_t size)
+{
+    return mem_track(tag, malloc(size));
+}
+
+void *mem_calloc(mem_tag_t tag, size_t num, size_t size)
+{
+    return mem_track(tag, calloc(num, size));
+}
+
+void *mem_memalign(mem_tag_t tag, size_t align, size_t size)
+{
+    return mem_track(tag, memalign(align, size));
+}
+
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size)
+{
+    size_t old_size = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL && size > 0)
+    {
+        return NULL;
+    }
+    mem_record(tag, -(int32_t)old_size, (ptr != NULL) ? -1 : 0);
+    return mem_track(tag, new_ptr);
+}
+
+void mem_free(mem_tag_t tag, void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    mem_record(tag, -(int32_t)malloc_usable_size(ptr), -1);
+    free(ptr);
+}
+
+void mem_get_stats(mem_tag_t tag, mem_tag_stats_t *stats)
+{
+    assert(tag < MEM_TAG_MAX);
+    *stats = mem_stats[tag];
+}
+
+void mem_report(const char *reason)
+{
+    debugf("mem: %s\n", reason);
+    for (int i = 0; i < MEM_TAG_MAX; i++)
+    {
+        const mem_tag_stats_t *stats = &mem_stats[i];
+        debugf("mem: %-5s %8lu bytes in %4lu allocations, peak %8lu, %5lu allocations since boot\n", mem_tag_names[i],
+               (unsigned long)stats->bytes, (unsigned long)stats->allocations, (unsigned long)stats->peak,
+               (unsigned long)stats->total);
+    }
+
+#ifdef __NEWLIB__
+    struct mallinfo mi = mallinfo();
+#else
+    struct mallinfo2 mi = mallinfo2();
+#endif
+    //Memory between the top of the heap and the stack has not been handed to malloc yet. With the free chunk at
+    //the top of the heap it makes up the largest block malloc can still return, less whatever the stack needs.
+    //Free chunks further down the heap can only be smaller.
+    uintptr_t heap_top = (uintptr_t)sbrk(0);
+    uintptr_t stack = (uintptr_t)__builtin_frame_address(0);
+    unsigned long unused = (stack > heap_top) ? stack - heap_top : 0;
+    debugf("mem: heap %lu bytes, %lu in use, %lu free; %lu unused below the stack, largest free block %lu\n",
+           (unsigned long)mi.arena, (unsigned long)mi.uordblks, (unsigned long)mi.fordblks, unused,
+           unused + (unsigned long)mi.keepcost);
+    debugf("mem: static reservations: prefetch pool %lu\n", (unsigned long)VOL_PREFETCH_MAX_BYTES);
+}
@@ -6,48 +6,174 @@
 #include "sound/audio.h"
 #include "sound/opl.h"
 #include "config.h"
+#include "n64/n64_audio.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_cache.h"
 
 #define MUSIC_INSTRUCTION_RATE 560 //Hz
 #define ADLIB_OP_SIZE 4
 #define MUSIC_NUM_CHANNELS 1
 #define MUSIC_BYTES_PER_SAMPLE 2
-#define MUSIC_SAMPLE_RATE 19200
-#define MUSIC_CHANNEL 0
+#define MUSIC_SAMPLE_RATE music_sample_rate
+#define MUSIC_MIN(a,b) (((a)<(b))?(a):(b))
+
+#define MUSIC_BANK_FILENAME "MUSIC.BNK"
+#define MUSIC_BANK_MAGIC 0x4D424E4B //MBNK
+#define MUSIC_WINDOW_SIZE 512       //Bytes per half of the DMA window. Must be a multiple of ADLIB_OP_SIZE
 
 uint8 music_on_flag = 1;
 static waveform_t music;
-static uint8 *music_data = NULL;
-static uint32 music_data_length;
 static sint8 music_index = -1;
 static uint32 adlib_instruction_position = 0;
 static uint32 delay_counter = 0;
+static uint32 music_sample_rate;
+
+//All music tracks are packed into one bank in the DFS image by tools/mkmusicbank, in the music index
+//order given by MUSIC_TRACKS in the Makefile. The register stream is played straight from ROM through
+//a small double buffered window, so a track change is constant time and needs no heap memory.
+typedef struct music_track_t
+{
+    uint32_t offset;
+    uint32_t length;
+} music_track_t;
+
+static uint32_t music_bank_rom = 0;
+static uint32_t music_num_tracks = 0;
+static music_track_t *music_tracks = NULL;
+static music_track_t *music_track = NULL;
+static uint8_t __attribute__((aligned(16))) music_window[2][MUSIC_WINDOW_SIZE];
+static uint32_t music_window_block[2];
+static bool music_window_pending = false; //A prefetch DMA was started and has not been waited on yet
 
-static const char music_filename_tbl[][13] = {
-    "MCAVES.MNI",
-    "MSCARRY.MNI",
-    "MBOSS.MNI",
-    "MRUNAWAY.MNI",
-    "MCIRCUS.MNI",
-    "MTEKWRD.MNI",
-    "MEASYLEV.MNI",
-    "MROCKIT.MNI",
-    "MHAPPY.MNI",
-    "MDEVO.MNI",
-    "MDADODA.MNI",
-    "MBELLS.MNI",
-    "MDRUMS.MNI",
-    "MBANJO.MNI",
-    "MEASY2.MNI",
-    "MTECK2.MNI",
-    "MTECK3.MNI",
-    "MTECK4.MNI",
-    "MZZTOP.MNI"};
-
-static uint32 get_delay(uint32 instruction_num)
-{
-    return (MUSIC_SAMPLE_RATE / MUSIC_INSTRUCTION_RATE) *
-           (uint32)((uint16)music_data[instruction_num * ADLIB_OP_SIZE + 2] +
-                    ((uint16)music_data[instruction_num * ADLIB_OP_SIZE + 3] << 8));
+//With the Expansion Pak the whole track is kept in the resident cache instead and the window is not used
+static uint8_t *music_resident = NULL;
+
+static uint8_t *music_cache_track(uint32_t index)
+{
+    char key[CACHE_KEY_LEN];
+    char name[12];
+    uint32_t size;
+    snprintf(name, sizeof(name), "%u", (unsigned)index);
+    cache_make_key(key, MUSIC_BANK_FILENAME, name);
+    uint8_t *data = (uint8_t *)cache_get(key, &size);
+    if (data == NULL)
+    {
+        uint32_t len = (music_tracks[index].length + 1) & ~1;
+        data = cache_put(key, len);
+        if (data == NULL)
+        {
+            return NULL;
+        }
+        data_cache_hit_writeback_invalidate(data, len);
+        dma_read(data, music_bank_rom + music_tracks[index].offset, len);
+    }
+    cache_pin(data, true);
+    return data;
+}
+
+//A prefetch only starts the DMA. It is finished off by the next music_op, normally in a later callback.
+static void music_window_fill(int half, uint32_t block, bool prefetch)
+{
+    uint32_t offset = block * MUSIC_WINDOW_SIZE;
+    uint32_t len = (MUSIC_MIN(MUSIC_WINDOW_SIZE, music_track->length - offset) + 1) & ~1;
+    data_cache_hit_writeback_invalidate(music_window[half], MUSIC_WINDOW_SIZE);
+    music_window_block[half] = block;
+    if (prefetch)
+    {
+        dma_read_raw_async(music_window[half], music_bank_rom + music_track->offset + offset, len);
+        music_window_pending = true;
+    }
+    else
+    {
+        dma_read(music_window[half], music_bank_rom + music_track->offset + offset, len);
+    }
+}
+
+//Return the adlib instruction from the window, refilling it from ROM as the track plays.
+//Entering a block starts an async prefetch of the next one into the other half, so playback rarely waits on a DMA.
+static const uint8_t *music_op(uint32_t instruction_num)
+{
+    uint32_t pos = instruction_num * ADLIB_OP_SIZE;
+    if (music_resident != NULL)
+    {
+        return &music_resident[pos];
+    }
+    if (music_window_pending)
+    {
+        dma_wait();
+        music_window_pending = false;
+    }
+    uint32_t block = pos / MUSIC_WINDOW_SIZE;
+    int half = block & 1;
+    if (music_window_block[half] != block)
+    {
+        music_window_fill(half, block, false);
+    }
+    if (pos % MUSIC_WINDOW_SIZE == 0)
+    {
+        uint32_t next = block + 1;
+        if (next * MUSIC_WINDOW_SIZE >= music_track->length)
+        {
+            next = 0;
+        }
+        if (music_window_block[half ^ 1] != next)
+        {
+            //Block 0 lives in half 0, so a wrap back to the start can only be prefetched if it
+            //doesn't clobber the half we're playing from.
+            if ((next & 1) != half)
+            {
+                music_window_fill(half ^ 1, next, true);
+            }
+        }
+    }
+    return &music_window[half][pos % MUSIC_WINDOW_SIZE];
+}
+
+//The bank index is big endian. Decode it byte by byte so the same code also runs in the host tools.
+static uint32_t music_bank_read32(int fp)
+{
+    uint8_t b[4];
+    dfs_read(b, sizeof(b), 1, fp);
+    return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+static void music_bank_init()
+{
+    if (music_tracks != NULL)
+    {
+        return;
+    }
+
+    int fp = dfs_open(MUSIC_BANK_FILENAME);
+    assert(fp >= 0);
+    uint32_t magic = music_bank_read32(fp);
+    assert(magic == MUSIC_BANK_MAGIC);
+    music_num_tracks = music_bank_read32(fp);
+    music_tracks = mem_alloc(MEM_TAG_AUDIO, sizeof(music_track_t) * music_num_tracks);
+    assert(music_tracks != NULL);
+    for (uint32_t i = 0; i < music_num_tracks; i++)
+    {
+        music_tracks[i].offset = music_bank_read32(fp);
+        music_tracks[i].length = music_bank_read32(fp);
+    }
+    dfs_close(fp);
+    music_bank_rom = dfs_rom_addr(MUSIC_BANK_FILENAME);
+}
+
+uint32_t music_bank_num_tracks(void)
+{
+    return music_num_tracks;
+}
+
+uint32_t music_bank_track_length(uint32_t index)
+{
+    return index < music_num_tracks ? music_tracks[index].length : 0;
+}
+
+static uint32 get_delay(const uint8_t *op)
+{
+    //Multiply first so rates that aren't a multiple of the instruction rate keep the right tempo
+    return (MUSIC_SAMPLE_RATE * (uint32)((uint16)op[2] + ((uint16)op[3] << 8))) / MUSIC_INSTRUCTION_RATE;
 }
 
 static void generate_music(Uint8 *stream, int len)
@@ -59,10 +185,11 @@ static void generate_music(Uint8 *stream, int len)
     {
         if (delay_counter == 0)
         {
-            adlib_write(music_data[adlib_instruction_position * ADLIB_OP_SIZE], music_data[adlib_instruction_position * ADLIB_OP_SIZE + 1]);
-            delay_counter = get_delay(adlib_instruction_position);
+            const uint8_t *op = music_op(adlib_instruction_position);
+            adlib_write(op[0], op[1]);
+            delay_counter = get_delay(op);
             adlib_instruction_position++;
-            if (adlib_instruction_position * ADLIB_OP_SIZE >= music_data_length)
+            if (adlib_instruction_position * ADLIB_OP_SIZE >= music_track->length)
             {
                 adlib_instruction_position = 0;
             }
@@ -86,9 +213,11 @@ static void generate_music(Uint8 *stream, int len)
 static void music_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking)
 {
     (void)ctx;
+    uint32_t start = get_ticks();
     uint8_t *dst = CachedAddr(samplebuffer_append(sbuf, wlen));
     generate_music(dst, wlen * MUSIC_NUM_CHANNELS * MUSIC_BYTES_PER_SAMPLE);
     data_cache_hit_writeback_invalidate(dst, wlen * NUM_CHANNELS * MUSIC_BYTES_PER_SAMPLE);
+    audio_stats_record(AUDIO_STAT_MUSIC, get_ticks() - start);
 }
 
 void load_music(uint16 new_music_index)
@@ -98,39 +227,47 @@ void load_music(uint16 new_music_index)
         return;
     }
 
-    adlib_instruction_position = 0;
-    delay_counter = 0;
-
+    //Stop the channel first so the AI interrupt is no longer reading the window
     if (music_index != -1)
     {
         stop_music();
     }
 
+    adlib_instruction_position = 0;
+    delay_counter = 0;
+
     if (music_index == new_music_index)
     {
         play_music();
         return;
     }
 
+    assert(new_music_index < music_num_tracks);
+    assert(music_tracks[new_music_index].length >= ADLIB_OP_SIZE);
     music_index = new_music_index;
-    if (music_data != NULL)
+    music_track = &music_tracks[music_index];
+    music_window_block[0] = music_window_block[1] = UINT32_MAX;
+    if (music_resident != NULL)
     {
-        free(music_data);
+        cache_pin(music_resident, false);
     }
-    music_data = load_file_in_new_buf(music_filename_tbl[music_index], &music_data_length);
-    assert(music_data != NULL);
+    music_resident = cache_enabled() ? music_cache_track(music_index) : NULL;
     play_music();
 }
 
 void music_init()
 {
     generator_add = 0; //Fixes warning of unused variable in opl.h
+    music_sample_rate = audio_get_profile()->music_rate;
     adlib_init(MUSIC_SAMPLE_RATE);
+    music_bank_init();
 }
 
 void stop_music()
 {
+    audio_lock();
     mixer_ch_stop(MUSIC_CHANNEL);
+    audio_unlock();
     music_index = -1;
 }
 
@@ -143,7 +280,9 @@ void play_music()
     music.read = music_read;
     music.loop_len = 0;
     music.ctx = (void *)&music;
+    audio_lock();
     mixer_ch_play(MUSIC_CHANNEL, &music);
+    audio_unlock();
 }
 
 void music_close()
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <string.h>
+#include "n64/n64_pad.h"
+
+//Filled from the VI interrupt, emptied by pad_read with interrupts disabled
+static pad_event_t pad_queue[PAD_QUEUE_SIZE];
+static uint32_t pad_head = 0;
+static uint32_t pad_tail = 0;
+static uint32_t pad_dropped = 0;
+
+static struct controller_data pad_latest;
+static uint32_t pad_last_buttons = 0;
+static uint32_t pad_vblanks = 0;
+
+//One joybus transaction per vblank, the same one controller_scan does
+static void pad_vi_interrupt(void)
+{
+    struct controller_data sample;
+    controller_read(&sample);
+    pad_vblanks++;
+
+    uint32_t buttons = sample.c[0].err ? 0 : (sample.c[0].data & PAD_BUTTONS_MASK);
+    uint32_t pressed = buttons & ~pad_last_buttons;
+    pad_latest = sample;
+    if (buttons == pad_last_buttons)
+    {
+        return;
+    }
+    pad_last_buttons = buttons;
+
+    if (pad_tail - pad_head == PAD_QUEUE_SIZE)
+    {
+        //Keep the presses so a tap still registers, only its exact time is lost
+        pad_event_t *newest = &pad_queue[(pad_tail - 1) % PAD_QUEUE_SIZE];
+        newest->data = sample.c[0].data;
+        newest->pressed |= pressed;
+        pad_dropped++;
+        return;
+    }
+
+    pad_event_t *event = &pad_queue[pad_tail % PAD_QUEUE_SIZE];
+    event->ticks = timer_ticks();
+    event->vblank = pad_vblanks;
+    event->data = sample.c[0].data;
+    event->pressed = pressed;
+    pad_tail++;
+}
+
+void pad_init(void)
+{
+    static bool initialised = false;
+    if (initialised)
+    {
+        return;
+    }
+    memset(&pad_latest, 0, sizeof(pad_latest));
+    register_VI_handler(pad_vi_interrupt);
+    initialised = true;
+}
+
+void pad_read(pad_input_t *input)
+{
+    memset(input, 0, sizeof(*input));
+    uint32_t pressed = 0;
+
+    disable_interrupts();
+    input->held = pad_latest;
+    input->down = pad_latest;
+    for (; pad_head != pad_tail; pad_head++)
+    {
+        pad_event_t *event = &pad_queue[pad_head % PAD_QUEUE_SIZE];
+        if (event->pressed && input->first_press_ticks == 0)
+        {
+            input->first_press_ticks = event->ticks;
+        }
+        pressed |= event->pressed;
+        input->events++;
+    }
+    input->dropped = pad_dropped;
+    pad_dropped = 0;
+    enable_interrupts();
+
+    input->held.c[0].data |= pressed;
+    input->down.c[0].data = (input->down.c[0].data & ~PAD_BUTTONS_MASK) | pressed;
+    for (int i = 1; i < 4; i++)
+    {
+        input->down.c[i].data &= ~PAD_BUTTONS_MASK;
+    }
+}
+
+void pad_flush(void)
+{
+    disable_interrupts();
+    pad_head = pad_tail;
+    pad_dropped = 0;
+    enable_interrupts();
+}
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Level maps are named after the episode and level number (A1.MNI, A2.MNI...) with BONUS1/BONUS2.MNI in between.
+//When the game loads a map, the next numbered map, the bonus maps and the current map again (for restarts after
+//dying) are staged with vol_prefetch, each followed by the backdrop its header asks for.
+
+#include <libdragon.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "n64/n64_vol.h"
+#include "n64/n64_idle.h"
+#include "n64/n64_prefetch.h"
+#include "n64/n64_mem.h"
+
+#define PREFETCH_NAME_LEN (VOL_INDEX_NAME_LEN + 1)
+#define PREFETCH_MAX_PLAN 4
+
+//Same order as the game's backdrop table. The backdrop number is in the low 5 bits of the map's first word.
+static const char *backdrop_files[] = {
+    "BDBLANK.MNI", "BDPIPE.MNI", "BDREDSKY.MNI", "BDROCKTK.MNI", "BDJUNGLE.MNI", "BDSTAR.MNI", "BDWIERD.MNI",
+    "BDCAVE.MNI", "BDICE.MNI", "BDSHRUM.MNI", "BDTECHMS.MNI", "BDNEWSKY.MNI", "BDSTAR2.MNI", "BDSTAR3.MNI",
+    "BDFOREST.MNI", "BDMOUNTN.MNI", "BDGUTS.MNI", "BDBRKTEC.MNI", "BDCLOUDS.MNI", "BDFUTCTY.MNI", "BDICE2.MNI",
+    "BDCLIFF.MNI", "BDSPOOKY.MNI", "BDCRYSTL.MNI", "BDCIRCUT.MNI", "BDCIRCPC.MNI",
+};
+#define NUM_BACKDROPS (sizeof(backdrop_files) / sizeof(backdrop_files[0]))
+
+static char prefetch_plan[PREFETCH_MAX_PLAN][PREFETCH_NAME_LEN];
+static int prefetch_plan_len = 0;
+static int prefetch_plan_next = 0;
+static char prefetch_map_pending[PREFETCH_NAME_LEN]; //Map whose backdrop still has to be queued
+
+static char prefetch_level_loaded[PREFETCH_NAME_LEN]; //Set by the load hook, picked up by the idle task
+static bool prefetch_level_loading = false;           //A map was loaded and the game has not polled input since
+static char prefetch_episode = 0;
+static int prefetch_level_number = 0;
+
+static bool prefetch_is_bonus(const char *filename)
+{
+    return strncasecmp(filename, "BONUS", 5) == 0;
+}
+
+//Numbered level map, eg A10.MNI
+static bool prefetch_parse_level(const char *filename, char *episode, int *number)
+{
+    if (!isalpha((unsigned char)filename[0]) || !isdigit((unsigned char)filename[1]))
+    {
+        return false;
+    }
+    char *end;
+    *episode = toupper((unsigned char)filename[0]);
+    *number = strtol(&filename[1], &end, 10);
+    return strcasecmp(end, ".MNI") == 0;
+}
+
+static void prefetch_plan_add(const char *filename)
+{
+    if (prefetch_plan_len < PREFETCH_MAX_PLAN)
+    {
+        snprintf(prefetch_plan[prefetch_plan_len++], PREFETCH_NAME_LEN, "%.12s", filename);
+    }
+}
+
+static void prefetch_on_load(const char *filename)
+{
+    char episode;
+    int number;
+    if (prefetch_parse_level(filename, &episode, &number))
+    {
+        prefetch_episode = episode;
+        prefetch_level_number = number;
+    }
+    else if (!prefetch_is_bonus(filename))
+    {
+        return;
+    }
+    snprintf(prefetch_level_loaded, PREFETCH_NAME_LEN, "%.12s", filename);
+    prefetch_level_loading = true;
+}
+
+//Start over from the map that was just loaded. Nothing is dropped until the game is idle again, so whatever
+//else load_level needs from the old plan (the backdrop) is still there when it asks.
+static void prefetch_replan(void)
+{
+    vol_prefetch_clear();
+    prefetch_plan_len = 0;
+    prefetch_plan_next = 0;
+    prefetch_map_pending[0] = '\0';
+
+    if (prefetch_episode != 0)
+    {
+        char next[PREFETCH_NAME_LEN + 8];
+        snprintf(next, sizeof(next), "%c%d.MNI", prefetch_episode, prefetch_level_number + 1);
+        prefetch_plan_add(next);
+    }
+    prefetch_plan_add(prefetch_level_loaded);
+    if (strcasecmp(prefetch_level_loaded, "BONUS1.MNI") != 0)
+    {
+        prefetch_plan_add("BONUS1.MNI");
+    }
+    if (strcasecmp(prefetch_level_loaded, "BONUS2.MNI") != 0)
+    {
+        prefetch_plan_add("BONUS2.MNI");
+    }
+    prefetch_level_loaded[0] = '\0';
+}
+
+static bool prefetch_task(void)
+{
+    if (prefetch_level_loaded[0] != '\0')
+    {
+        prefetch_replan();
+    }
+    if (vol_prefetch_step())
+    {
+        return true;
+    }
+
+    //The backdrop is only known once its map has been staged
+    uint32_t size;
+    const uint8_t *map = (prefetch_map_pending[0] != '\0') ? vol_prefetch_peek(prefetch_map_pending, &size) : NULL;
+    prefetch_map_pending[0] = '\0';
+    if (map != NULL && size >= 2)
+    {
+        uint32_t backdrop = (map[0] | (map[1] << 8)) & 0x1F;
+        if (backdrop < NUM_BACKDROPS && vol_prefetch(backdrop_files[backdrop]))
+        {
+            return true;
+        }
+    }
+
+    while (prefetch_plan_next < prefetch_plan_len)
+    {
+        const char *filename = prefetch_plan[prefetch_plan_next++];
+        if (vol_prefetch(filename))
+        {
+            snprintf(prefetch_map_pending, PREFETCH_NAME_LEN, "%.12s", filename);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool prefetch_level_started(void)
+{
+    if (!prefetch_level_loading)
+    {
+        return false;
+    }
+    prefetch_level_loading = false;
+    mem_report("level loaded");
+    return true;
+}
+
+void prefetch_init(void)
+{
+    vol_set_load_hook(prefetch_on_load);
+    idle_add_task(prefetch_task);
+}
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+#include "game.h"
+#include "files/vol.h"
+#include "n64/n64_quicksave.h"
+#include "n64/n64_sram.h"
+#include "n64/n64_crc.h"
+#include "n64/n64_lz.h"
+#include "n64/n64_mem.h"
+
+//The engine objects are partially linked with n64/cosmo_state.ld, which brackets all of their data with these.
+extern uint8_t __cosmo_data_start[], __cosmo_data_end[];
+extern uint8_t __cosmo_bss_start[], __cosmo_bss_end[];
+
+uint32_t sramfs_region_end(void);
+
+//The quicksave takes whatever SRAM is left after the save files. It moves if the file table grows, which only
+//costs the quicksave that was there.
+#define QUICKSAVE_SRAM_OFFSET sramfs_region_end()
+#define QUICKSAVE_SRAM_SIZE (SRAM_SIZE - QUICKSAVE_SRAM_OFFSET)
+
+//Least room the snapshot is given however large the save files grow. A snapshot that does not fit in what is
+//left is refused when it is taken.
+#ifndef QUICKSAVE_MIN_SRAM_SIZE
+#define QUICKSAVE_MIN_SRAM_SIZE 0x4000
+#endif
+_Static_assert(SRAMFS_END + QUICKSAVE_MIN_SRAM_SIZE <= SRAM_SIZE, "Quicksave does not fit in SRAM after the save files");
+#define QUICKSAVE_MAGIC 0x51534156 //QSAV
+#define QUICKSAVE_VERSION 2
+
+//Most heap blocks the engine can hold at once and still be quicksaved
+#ifndef QUICKSAVE_MAX_BLOCKS
+#define QUICKSAVE_MAX_BLOCKS 256
+#endif
+
+typedef struct quicksave_header_t
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t level;
+    uint32_t layout;      //Fingerprint of the engine's data layout. Changes with every rebuild.
+    uint32_t blocks_size; //Compressed size of the engine's heap blocks
+    uint32_t data_size;   //Compressed size of .data
+    uint32_t bss_size;    //Compressed size of .bss
+    uint32_t crc;         //CRC of the compressed payload
+    uint32_t header_crc;
+} quicksave_header_t;
+
+_Static_assert(sizeof(quicksave_header_t) % SRAM_SECTOR_SIZE == 0, "Header must be whole sectors");
+
+//Heap blocks the engine holds pointers to. Its malloc, calloc, realloc and free are wrapped at its partial link
+//(see the Makefile) so everything it allocates itself is listed here, and the contents go into the snapshot
+//after the sections. Assets the port hands it are listed as well but only checked to still be in place on
+//restore, since the engine only reads them.
+typedef struct quicksave_block_t
+{
+    uint8_t *ptr;
+    uint32_t size;
+    uint32_t saved; //Contents are part of the snapshot
+} quicksave_block_t;
+
+static quicksave_block_t quicksave_blocks[QUICKSAVE_MAX_BLOCKS];
+static int quicksave_num_blocks = 0;
+static bool quicksave_blocks_lost = false; //The table overflowed, so the engine holds blocks it does not know of
+
+static void quicksave_track(void *ptr, uint32_t size, bool saved)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    if (quicksave_num_blocks == QUICKSAVE_MAX_BLOCKS)
+    {
+        quicksave_blocks_lost = true;
+        return;
+    }
+    quicksave_blocks[quicksave_num_blocks++] = (quicksave_block_t){ptr, size, saved};
+}
+
+void quicksave_untrack(void *ptr)
+{
+    for (int i = 0; i < quicksave_num_blocks; i++)
+    {
+        if (quicksave_blocks[i].ptr == ptr)
+        {
+            quicksave_blocks[i] = quicksave_blocks[--quicksave_num_blocks];
+            return;
+        }
+    }
+}
+
+void quicksave_track_asset(void *ptr, uint32_t size)
+{
+    quicksave_track(ptr, size, false);
+}
+
+//Only the engine's references are wrapped, so malloc and free in here are the real ones.
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    quicksave_track(ptr, size, true);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    void *ptr = calloc(num, size);
+    quicksave_track(ptr, num * size, true);
+    return ptr;
+}
+
+void *__wrap_realloc(void *old, size_t size)
+{
+    void *ptr = realloc(old, size);
+    if (ptr != NULL || size == 0)
+    {
+        quicksave_untrack(old);
+        quicksave_track(ptr, size, true);
+    }
+    return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    quicksave_untrack(ptr);
+    free(ptr);
+}
+
+unsigned char *__wrap_vol_file_extract_by_name(const char *vol_filename, const char *filename, uint32 *bytes_read)
+{
+    unsigned char *data = vol_file_extract_by_name(vol_filename, filename, bytes_read);
+    quicksave_track_asset(data, *bytes_read);
+    return data;
+}
+
+//The number of blocks, the block table, then the contents of the saved blocks
+static uint32_t quicksave_blocks_raw_size(void)
+{
+    uint32_t size = sizeof(uint32_t) + quicksave_num_blocks * sizeof(quicksave_block_t);
+    for (int i = 0; i < quicksave_num_blocks; i++)
+    {
+        size += quicksave_blocks[i].saved ? quicksave_blocks[i].size : 0;
+    }
+    return size;
+}
+
+static uint8_t *quicksave_blocks_pack(uint32_t *size)
+{
+    *size = quicksave_blocks_raw_size();
+    uint8_t *raw = mem_alloc(MEM_TAG_SAVE, *size);
+    if (raw == NULL)
+    {
+        return NULL;
+    }
+    uint32_t count = quicksave_num_blocks;
+    memcpy(raw, &count, sizeof(count));
+    memcpy(raw + sizeof(count), quicksave_blocks, count * sizeof(quicksave_block_t));
+    uint8_t *pos = raw + sizeof(count) + count * sizeof(quicksave_block_t);
+    for (int i = 0; i < quicksave_num_blocks; i++)
+    {
+        if (quicksave_blocks[i].saved)
+        {
+            memcpy(pos, quicksave_blocks[i].ptr, quicksave_blocks[i].size);
+            pos += quicksave_blocks[i].size;
+        }
+    }
+    return raw;
+}
+
+//The saved table must list exactly the blocks the engine holds now, or the pointers in the sections are stale
+static bool quicksave_blocks_match(const uint8_t *raw)
+{
+    uint32_t count;
+    memcpy(&count, raw, sizeof(count));
+    if (count != (uint32_t)quicksave_num_blocks)
+    {
+        return false;
+    }
+    const quicksave_block_t *saved = (const quicksave_block_t *)(raw + sizeof(count));
+    for (int i = 0; i < quicksave_num_blocks; i++)
+    {
+        bool found = false;
+        for (int j = 0; j < quicksave_num_blocks && !found; j++)
+        {
+            found = memcmp(&saved[i], &quicksave_blocks[j], sizeof(quicksave_block_t)) == 0;
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void quicksave_blocks_unpack(const uint8_t *raw)
+{
+    const quicksave_block_t *saved = (const quicksave_block_t *)(raw + sizeof(uint32_t));
+    const uint8_t *pos = raw + sizeof(uint32_t) + quicksave_num_blocks * sizeof(quicksave_block_t);
+    for (int i = 0; i < quicksave_num_blocks; i++)
+    {
+        if (saved[i].saved)
+        {
+            memcpy(saved[i].ptr, pos, saved[i].size);
+            pos += saved[i].size;
+        }
+    }
+}
+
+static uint32_t quicksave_layout(void)
+{
+    uintptr_t layout[] = {
+        (uintptr_t)__cosmo_data_start, (uintptr_t)__cosmo_data_end,
+        (uintptr_t)__cosmo_bss_start, (uintptr_t)__cosmo_bss_end,
+    };
+    return crc32_update(0, layout, sizeof(layout));
+}
+
+static bool quicksave_read_header(quicksave_header_t *header)
+{
+    static quicksave_header_t sram_header __attribute__((aligned(16)));
+    sram_dma_read(&sram_header, QUICKSAVE_SRAM_OFFSET, sizeof(sram_header));
+    sram_dma_wait();
+    *header = sram_header;
+    return header->magic == QUICKSAVE_MAGIC &&
+           header->version == QUICKSAVE_VERSION &&
+           header->header_crc == crc32_update(0, header, offsetof(quicksave_header_t, header_crc)) &&
+           header->blocks_size + header->data_size + header->bss_size <=
+               QUICKSAVE_SRAM_SIZE - sizeof(quicksave_header_t);
+}
+
+bool quicksave_save(void)
+{
+    uint32_t start = get_ticks();
+    if (quicksave_blocks_lost)
+    {
+        debugf("quicksave: the engine holds more than %d heap blocks, cannot save\n", QUICKSAVE_MAX_BLOCKS);
+        return false;
+    }
+
+    static quicksave_header_t header __attribute__((aligned(16)));
+    header.magic = QUICKSAVE_MAGIC;
+    header.version = QUICKSAVE_VERSION;
+    header.level = current_level;
+    header.layout = quicksave_layout();
+
+    uint32_t blocks_raw_size;
+    uint32_t payload_max = QUICKSAVE_SRAM_SIZE - sizeof(header);
+    uint8_t *blocks = quicksave_blocks_pack(&blocks_raw_size);
+    uint8_t *payload = mem_memalign(MEM_TAG_SAVE, 16, payload_max);
+    if (blocks == NULL || payload == NULL)
+    {
+        debugf("quicksave: out of memory\n");
+        mem_free(MEM_TAG_SAVE, blocks);
+        mem_free(MEM_TAG_SAVE, payload);
+        return false;
+    }
+
+    //Heap blocks, .data and .bss one after the other. A size of 0 means that part did not fit.
+    uint32_t used = 0;
+    header.blocks_size = lz_compress(blocks, blocks_raw_size, payload, payload_max);
+    used += header.blocks_size;
+    header.data_size = (used == 0) ? 0 :
+        lz_compress(__cosmo_data_start, __cosmo_data_end - __cosmo_data_start, payload + used, payload_max - used);
+    used += header.data_size;
+    header.bss_size = (header.data_size == 0) ? 0 :
+        lz_compress(__cosmo_bss_start, __cosmo_bss_end - __cosmo_bss_start, payload + used, payload_max - used);
+    mem_free(MEM_TAG_SAVE, blocks);
+    if (header.bss_size == 0)
+    {
+        debugf("quicksave: state does not fit in %lu bytes of SRAM\n", payload_max);
+        mem_free(MEM_TAG_SAVE, payload);
+        return false;
+    }
+    uint32_t payload_size = used + header.bss_size;
+    header.crc = crc32_update(0, payload, payload_size);
+    header.header_crc = crc32_update(0, &header, offsetof(quicksave_header_t, header_crc));
+    uint32_t compressed = get_ticks();
+
+    //Payload first, header last. A cut write leaves a header whose CRC does not match the payload.
+    sram_dma_write(payload, QUICKSAVE_SRAM_OFFSET + sizeof(header), (payload_size + SRAM_SECTOR_SIZE - 1) & ~(SRAM_SECTOR_SIZE - 1));
+    sram_dma_write(&header, QUICKSAVE_SRAM_OFFSET, sizeof(header));
+    sram_dma_wait();
+    mem_free(MEM_TAG_SAVE, payload);
+
+    debugf("quicksave: saved level %d with %d heap blocks, %lu -> %lu bytes, compress %lluus, write %lluus\n",
+           header.level, quicksave_num_blocks,
+           (uint32_t)((__cosmo_data_end - __cosmo_data_start) + (__cosmo_bss_end - __cosmo_bss_start) + blocks_raw_size),
+           payload_size, TICKS_TO_US(compressed - start), TICKS_TO_US(get_ticks() - compressed));
+    return true;
+}
+
+bool quicksave_load(void)
+{
+    uint32_t start = get_ticks();
+    quicksave_header_t header;
+    if (!quicksave_read_header(&header))
+    {
+        debugf("quicksave: no quicksave found\n");
+        return false;
+    }
+    //The level's graphics are not part of the snapshot, only checked to be at the same place
+    if (header.layout != quicksave_layout() || header.level != current_level)
+    {
+        debugf("quicksave: saved on level %d or by another build, not restoring\n", header.level);
+        return false;
+    }
+
+    uint32_t payload_size = header.blocks_size + header.data_size + header.bss_size;
+    uint32_t aligned_size = (payload_size + SRAM_SECTOR_SIZE - 1) & ~(SRAM_SECTOR_SIZE - 1);
+    uint32_t blocks_raw_size = quicksave_blocks_raw_size();
+    uint8_t *payload = mem_memalign(MEM_TAG_SAVE, 16, aligned_size);
+    uint8_t *blocks = mem_alloc(MEM_TAG_SAVE, blocks_raw_size);
+    if (payload == NULL || blocks == NULL)
+    {
+        debugf("quicksave: out of memory\n");
+        mem_free(MEM_TAG_SAVE, payload);
+        mem_free(MEM_TAG_SAVE, blocks);
+        return false;
+    }
+    sram_dma_read(payload, QUICKSAVE_SRAM_OFFSET + sizeof(header), aligned_size);
+    sram_dma_wait();
+
+    const char *result;
+    bool ok = false;
+    if (crc32_update(0, payload, payload_size) != header.crc)
+    {
+        result = "corrupt quicksave, could not restore";
+    }
+    else if (lz_decompress(payload, header.blocks_size, blocks, blocks_raw_size) != blocks_raw_size ||
+             !quicksave_blocks_match(blocks))
+    {
+        result = "the engine's heap has changed since the quicksave, not restoring";
+    }
+    else
+    {
+        //Straight back into place. Nothing in here can fail once the CRC and the block table have passed.
+        uint8_t *pos = payload + header.blocks_size;
+        uint32_t data_len = __cosmo_data_end - __cosmo_data_start;
+        uint32_t bss_len = __cosmo_bss_end - __cosmo_bss_start;
+        ok = lz_decompress(pos, header.data_size, __cosmo_data_start, data_len) == data_len &&
+             lz_decompress(pos + header.data_size, header.bss_size, __cosmo_bss_start, bss_len) == bss_len;
+        quicksave_blocks_unpack(blocks);
+        result = ok ? "restored" : "corrupt quicksave, could not restore";
+    }
+    mem_free(MEM_TAG_SAVE, payload);
+    mem_free(MEM_TAG_SAVE, blocks);
+
+    debugf("quicksave: %s level %d in %lluus\n", result, header.level, TICKS_TO_US(get_ticks() - start));
+    return ok;
+}
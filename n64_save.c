@@ -1,16 +1,52 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #include <libdragon.h>
+#include <stddef.h>
 #include <string.h>
 #include <malloc.h>
 #include <fcntl.h>
 #include <system.h>
-#include "n64/regsinternal.h"
+#include "n64/n64_sram.h"
+#include "n64/n64_crc.h"
+#include "n64/n64_mem.h"
 
+//Original layout. Each file was stored in place after this magic number. Only read now to migrate old saves.
 static const uint32_t SRAM_MAGIC = 0x64646464;
 #define SRAMFS_MIN(a,b) (((a)<(b))?(a):(b))
 #define SRAMFS_MAX(a,b) (((a)>(b))?(a):(b))
 
+//SRAMFS v2 layout, starting at SRAMFS_BASE so the v1 files below it stay intact until migration is complete.
+//  superblock sector
+//  per file: slot 0 header sector, slot 0 data, slot 1 header sector, slot 1 data
+//A save writes only the sectors that differ in the inactive slot, then that slot's header with a newer
+//generation. The header is queued last, so it is the commit point. A torn write leaves a header
+//that is missing or fails its CRC, and the previous slot is used instead.
+#define SRAMFS_BASE 0x1000
+#define SRAMFS_SUPER_MAGIC 0x53465332 //SFS2
+#define SRAMFS_SLOT_MAGIC 0x534C4F54 //SLOT
+#define SRAMFS_VERSION 2
+#define SRAMFS_ALIGN(x) (((x) + SRAM_SECTOR_SIZE - 1) & ~(SRAM_SECTOR_SIZE - 1))
+
+typedef struct sramfs_super_t
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_files;
+    uint32_t layout; //CRC of the file table this layout was built for
+    uint32_t crc;    //CRC of the fields above
+} sramfs_super_t;
+
+typedef struct sramfs_slot_t
+{
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t length;
+    uint32_t crc; //CRC of the slot data
+} sramfs_slot_t;
+
+_Static_assert(sizeof(sramfs_super_t) == SRAM_SECTOR_SIZE, "Superblock must be one sector");
+_Static_assert(sizeof(sramfs_slot_t) == SRAM_SECTOR_SIZE, "Slot header must be one sector");
+
 typedef struct sram_files_t
 {
     const char *name;
@@ -18,9 +54,25 @@ typedef struct sram_files_t
     uint32_t offset;
 } sram_files_t;
 
+typedef struct sramfs_file_t
+{
+    uint32_t slot_offset[2]; //Offset of each slot header within the v2 region
+    uint32_t data_size;
+    uint32_t generation;
+    int active;              //Slot holding the current contents, -1 if the file does not exist yet
+    bool dirty;
+    uint32_t slot_ticket[2]; //Last queued write of each slot. Its shadow bytes are the DMA source until then.
+    uint8_t *data;           //Working copy the game reads and writes, padded to whole sectors
+} sramfs_file_t;
+
 sram_files_t *sram_files = NULL;
 int sram_num_files = 0;
 
+static sramfs_file_t *sramfs_files = NULL;
+static uint8_t *sram_shadow = NULL; //RAM copy of the whole v2 region
+static uint32_t sram_shadow_size = 0;
+static bool sramfs_readonly = false; //Set when SRAM holds a v2 region this build cannot lay out
+
 static int sram_get_handle_by_name(const char *name)
 {
     for (int i = 1; i <= sram_num_files; i++)
@@ -43,128 +95,248 @@ static int sram_get_file_start_by_handle(int handle)
     return offset;
 }
 
-uint8_t __attribute__((aligned(16))) sector_cache[16];
-static volatile struct PI_regs_s * const PI_regs = (struct PI_regs_s *)0xa4600000;
-static void _dma_read(void * ram_address, unsigned long pi_address, unsigned long len) 
+//CRC of the first num_files entries of the file table
+static uint32_t sramfs_layout_crc(int num_files)
 {
-    disable_interrupts();
-    dma_wait();
-    MEMORY_BARRIER();
-    PI_regs->ram_address = ram_address;
-    MEMORY_BARRIER();
-    PI_regs->pi_address = pi_address;
-    MEMORY_BARRIER();
-    PI_regs->write_length = len-1;
-    MEMORY_BARRIER();
-    dma_wait();
-    enable_interrupts();
+    uint32_t crc = 0;
+    for (int i = 1; i <= num_files; i++)
+    {
+        crc = crc32_update(crc, sram_files[i].name, strlen(sram_files[i].name));
+        crc = crc32_update(crc, &sram_files[i].size, sizeof(sram_files[i].size));
+    }
+    return crc;
 }
 
-static void _dma_write(void * ram_address, unsigned long pi_address, unsigned long len) 
+static bool sramfs_slot_valid(sramfs_file_t *f, int slot, sramfs_slot_t *hdr)
 {
-    disable_interrupts();
-    dma_wait();
-    MEMORY_BARRIER();
-    PI_regs->ram_address = (void*)ram_address;
-    MEMORY_BARRIER();
-    PI_regs->pi_address = pi_address;
-    MEMORY_BARRIER();
-    PI_regs->read_length = len-1;
-    MEMORY_BARRIER();
-    dma_wait();
-    enable_interrupts();
+    memcpy(hdr, &sram_shadow[f->slot_offset[slot]], sizeof(sramfs_slot_t));
+    if (hdr->magic != SRAMFS_SLOT_MAGIC || hdr->length != f->data_size)
+    {
+        return false;
+    }
+    uint8_t *data = &sram_shadow[f->slot_offset[slot] + sizeof(sramfs_slot_t)];
+    return crc32_update(0, data, f->data_size) == hdr->crc;
 }
 
-//Reading and writing to SRAM via DMA must occur from a 16 bytes aligned buffer. For Omnispeak, the save file
-//can be greater than 1 SRAM bank (32kB), so I need to be able to manage access multiple banks contiguously from non aligned buffers at random lengths.
-//I read and write by 16 byte 'sectors' and manage the banking automatically. If a read crosses to a different bank this is handled here.
-static void read_sram(uint8_t *dst, uint32_t offset, int len)
+//Pick the newest valid slot of each file and load it into the working copy
+static void sramfs_mount(void)
 {
-    assert(offset + len < 0x18000);
-
-    uint32_t aligned_offset;
-    uint32_t banked_offset;
-    while (len > 0)
+    for (int i = 1; i <= sram_num_files; i++)
     {
-        //Make sure we're on a 32bit boundary in a 16 byte sector
-        aligned_offset = offset - (offset % 4);
-        aligned_offset = aligned_offset - (aligned_offset % 16);
+        sramfs_file_t *f = &sramfs_files[i];
+        sramfs_slot_t hdr[2];
+        bool valid[2] = {sramfs_slot_valid(f, 0, &hdr[0]), sramfs_slot_valid(f, 1, &hdr[1])};
 
-        //Select the right bank
-        if (aligned_offset > 0xFFFF)
+        f->active = -1;
+        if (valid[0] && valid[1])
         {
-            banked_offset = aligned_offset - (0xFFFF + 1);
-            banked_offset |= (2 << 18);
+            f->active = ((int32_t)(hdr[1].generation - hdr[0].generation) > 0) ? 1 : 0;
         }
-        else if (aligned_offset > 0x7FFF)
+        else if (valid[0] || valid[1])
         {
-            banked_offset = aligned_offset - (0x7FFF + 1);
-            banked_offset |= (1 << 18);
+            f->active = valid[0] ? 0 : 1;
         }
-        else
+
+        if (f->active >= 0)
         {
-            banked_offset = aligned_offset;
+            f->generation = hdr[f->active].generation;
+            memcpy(f->data, &sram_shadow[f->slot_offset[f->active] + sizeof(sramfs_slot_t)], f->data_size);
         }
-
-        //Read a sector of data from SRAM
-        _dma_read(sector_cache, 0x08000000 + (banked_offset & 0x07FFFFFF), 16);
-        data_cache_hit_writeback_invalidate(sector_cache, 16);
-
-        //Copy only the required bytes into the dst buffer
-        int br = SRAMFS_MIN(len, 16 - (offset - aligned_offset));
-        memcpy(dst, sector_cache + (offset - aligned_offset), br);
-
-        dst += br;
-        offset += br;
-        len -= br;
     }
 }
 
-static void write_sram(uint8_t *src, uint32_t offset, int len)
+//Write the working copy into the inactive slot, touching only the sectors that differ from what that slot
+//already holds, then queue the new slot header.
+static void sramfs_commit(int handle)
 {
-    assert(offset + len < 0x18000);
-
-    uint32_t aligned_offset;
-    uint32_t banked_offset;
-    while (len > 0)
+    sramfs_file_t *f = &sramfs_files[handle];
+    if (!f->dirty)
+    {
+        return;
+    }
+    if (sramfs_readonly)
     {
-        //Make sure we're on a 32bit boundary in a 16 byte sector
-        aligned_offset = offset - (offset % 4);
-        aligned_offset = aligned_offset - (aligned_offset % 16);
+        debugf("sramfs: %s not saved, SRAM holds an unknown layout\n", sram_files[handle].name);
+        f->dirty = false;
+        return;
+    }
+
+    int target = (f->active < 0) ? 0 : !f->active;
+
+    //The shadow of the target slot is rewritten below, so its previous writes must have left it first
+    sram_dma_wait_ticket(f->slot_ticket[target]);
+
+    uint32_t hdr_offset = f->slot_offset[target];
+    uint32_t data_offset = hdr_offset + sizeof(sramfs_slot_t);
+    uint32_t num_sectors = SRAMFS_ALIGN(f->data_size) / SRAM_SECTOR_SIZE;
 
-        //Select the right bank
-        if (aligned_offset > 0xFFFF)
+    uint32_t sector = 0;
+    while (sector < num_sectors)
+    {
+        uint32_t pos = sector * SRAM_SECTOR_SIZE;
+        if (memcmp(&sram_shadow[data_offset + pos], &f->data[pos], SRAM_SECTOR_SIZE) == 0)
         {
-            banked_offset = aligned_offset - (0xFFFF + 1);
-            banked_offset |= (2 << 18);
+            sector++;
+            continue;
         }
-        else if (aligned_offset > 0x7FFF)
+        uint32_t run_start = sector;
+        while (sector < num_sectors)
         {
-            banked_offset = aligned_offset - (0x7FFF + 1);
-            banked_offset |= (1 << 18);
+            pos = sector * SRAM_SECTOR_SIZE;
+            if (memcmp(&sram_shadow[data_offset + pos], &f->data[pos], SRAM_SECTOR_SIZE) == 0)
+            {
+                break;
+            }
+            memcpy(&sram_shadow[data_offset + pos], &f->data[pos], SRAM_SECTOR_SIZE);
+            sector++;
         }
-        else
+        uint32_t run_offset = data_offset + run_start * SRAM_SECTOR_SIZE;
+        sram_dma_write(&sram_shadow[run_offset], SRAMFS_BASE + run_offset, (sector - run_start) * SRAM_SECTOR_SIZE);
+    }
+
+    sramfs_slot_t hdr = {
+        .magic = SRAMFS_SLOT_MAGIC,
+        .generation = f->generation + 1,
+        .length = f->data_size,
+        .crc = crc32_update(0, f->data, f->data_size),
+    };
+    memcpy(&sram_shadow[hdr_offset], &hdr, sizeof(hdr));
+    f->slot_ticket[target] = sram_dma_write(&sram_shadow[hdr_offset], SRAMFS_BASE + hdr_offset, sizeof(hdr));
+
+    f->generation = hdr.generation;
+    f->active = target;
+    f->dirty = false;
+}
+
+//Queue the superblock for the current file table behind everything already queued, and wait for it to land
+static void sramfs_super_write(void)
+{
+    sramfs_super_t super = {
+        .magic = SRAMFS_SUPER_MAGIC,
+        .version = SRAMFS_VERSION,
+        .num_files = sram_num_files,
+        .layout = sramfs_layout_crc(sram_num_files),
+    };
+    super.crc = crc32_update(0, &super, offsetof(sramfs_super_t, crc));
+    memcpy(sram_shadow, &super, sizeof(super));
+    sram_dma_write(sram_shadow, SRAMFS_BASE, sizeof(super));
+    sram_dma_wait();
+}
+
+//Finish a v2 region that has no superblock yet. Files with a valid v2 slot keep it, the rest are carried over
+//from the v1 layout if they exist there. Everything but the superblock is written first, so an interrupted
+//migration is picked up again on the next boot.
+static void sramfs_migrate_v1(void)
+{
+    uint32_t v1_size = SRAMFS_ALIGN(sram_get_file_start_by_handle(sram_num_files + 1));
+    uint8_t *v1 = mem_memalign(MEM_TAG_SAVE, SRAM_SECTOR_SIZE, v1_size);
+    assert(v1 != NULL);
+    sram_dma_read(v1, 0, v1_size);
+    sram_dma_wait();
+
+    sramfs_mount();
+    int kept = 0;
+    int migrated = 0;
+    for (int i = 1; i <= sram_num_files; i++)
+    {
+        sramfs_file_t *f = &sramfs_files[i];
+        if (f->active >= 0)
         {
-            banked_offset = aligned_offset;
+            kept++;
+            continue;
         }
 
-        //Read a sector of data from SRAM if writing to an unaligned sector
-        //Can skip this read/modify/write if we're aligned and atleast 16 byte.
-        if (len < 16 || (offset - aligned_offset) != 0)
+        uint8_t *v1_file = &v1[sram_get_file_start_by_handle(i)];
+        uint32_t magic;
+        memcpy(&magic, v1_file, sizeof(magic));
+
+        memset(&sram_shadow[f->slot_offset[0]], 0, 2 * (sizeof(sramfs_slot_t) + SRAMFS_ALIGN(f->data_size)));
+        memset(f->data, 0, SRAMFS_ALIGN(f->data_size));
+        f->generation = 0;
+        f->dirty = false;
+        if (magic != SRAM_MAGIC)
         {
-            _dma_read(sector_cache, 0x08000000 + (banked_offset & 0x07FFFFFF), 16);
-            data_cache_hit_writeback_invalidate(sector_cache, 16);
+            continue;
         }
 
-        int bw = SRAMFS_MIN(len, 16 - (offset - aligned_offset));
-        memcpy(sector_cache + (offset - aligned_offset), src, bw);
-        data_cache_hit_writeback_invalidate(sector_cache, 16);
-        _dma_write(sector_cache, 0x08000000 + (banked_offset & 0x07FFFFFF), 16);
+        memcpy(f->data, v1_file + sizeof(SRAM_MAGIC), f->data_size);
+        sramfs_slot_t hdr = {
+            .magic = SRAMFS_SLOT_MAGIC,
+            .generation = 1,
+            .length = f->data_size,
+            .crc = crc32_update(0, f->data, f->data_size),
+        };
+        memcpy(&sram_shadow[f->slot_offset[0]], &hdr, sizeof(hdr));
+        memcpy(&sram_shadow[f->slot_offset[0] + sizeof(hdr)], f->data, f->data_size);
+        f->active = 0;
+        f->generation = hdr.generation;
+        migrated++;
+    }
+    mem_free(MEM_TAG_SAVE, v1);
+
+    sram_dma_write(&sram_shadow[sizeof(sramfs_super_t)], SRAMFS_BASE + sizeof(sramfs_super_t),
+                   sram_shadow_size - sizeof(sramfs_super_t));
+    sramfs_super_write();
+    debugf("sramfs: wrote v%d superblock, kept %d v2 files, migrated %d v1 files\n", SRAMFS_VERSION, kept, migrated);
+}
+
+//Superblock that was read from SRAM, if its magic and CRC check out
+static bool sramfs_super_read(sramfs_super_t *super)
+{
+    memcpy(super, sram_shadow, sizeof(*super));
+    return super->magic == SRAMFS_SUPER_MAGIC &&
+           super->crc == crc32_update(0, super, offsetof(sramfs_super_t, crc));
+}
+
+//Work out what the v2 region holds. A valid v2 slot is never written over, whether the superblock is damaged
+//or the file table has changed since it was written.
+static void sramfs_open_region(void)
+{
+    sramfs_super_t super;
+    if (!sramfs_super_read(&super))
+    {
+        sramfs_migrate_v1();
+        return;
+    }
+
+    if (super.version == SRAMFS_VERSION && super.num_files == sram_num_files &&
+        super.layout == sramfs_layout_crc(sram_num_files))
+    {
+        sramfs_mount();
+        return;
+    }
+
+    //Files added at the end of the table leave the slots of the existing ones where they were
+    if (super.version == SRAMFS_VERSION && super.num_files < sram_num_files &&
+        super.layout == sramfs_layout_crc(super.num_files))
+    {
+        uint32_t old_end = sramfs_files[super.num_files + 1].slot_offset[0];
+        memset(&sram_shadow[old_end], 0, sram_shadow_size - old_end);
+        sramfs_mount();
+        sram_dma_write(&sram_shadow[old_end], SRAMFS_BASE + old_end, sram_shadow_size - old_end);
+        sramfs_super_write();
+        debugf("sramfs: added %d files to the layout\n", sram_num_files - super.num_files);
+        return;
+    }
+
+    //Anything else cannot be mapped onto this file table. Leave it alone rather than format over it.
+    for (int i = 1; i <= sram_num_files; i++)
+    {
+        sramfs_files[i].active = -1;
+    }
+    sramfs_readonly = true;
+    debugf("sramfs: SRAM holds v%u with %u files in another layout, saving is disabled\n", super.version,
+           super.num_files);
+}
 
-        src += bw;
-        offset += bw;
-        len -= bw;
+//Commits every file with unsaved changes. The writes are queued and this returns without waiting for them.
+int sramfs_sync(void)
+{
+    for (int i = 1; i <= sram_num_files; i++)
+    {
+        sramfs_commit(i);
     }
+    return 0;
 }
 
 static void *__open(char *name, int flags)
@@ -176,42 +348,27 @@ static void *__open(char *name, int flags)
         return NULL;
     }
 
-    int offset = sram_get_file_start_by_handle(handle);
-    int magic;
-    read_sram((uint8_t *)&magic, offset, 4);
+    sramfs_file_t *f = &sramfs_files[handle];
 
-    //File is meant to be ready only, see if it exists by reading the first few bytes
-    //to see if the magic number is present.
-    if (flags == O_RDONLY && magic != SRAM_MAGIC)
+    //File is meant to be ready only, see if it exists by checking it has a valid slot.
+    if (flags == O_RDONLY && f->active < 0)
     {
         return NULL;
     }
 
-    //We should 'create' the file
-    if (magic != SRAM_MAGIC)
+    //We should 'create' the file. It is written to SRAM zeroed when it is closed.
+    if (f->active < 0)
     {
-        //Write the magic number then return handle to the file, then zero the remainder
-        magic = SRAM_MAGIC;
-        write_sram((uint8_t *)&magic, offset, sizeof(SRAM_MAGIC));
-        uint8_t zero[16] = {0};
-        data_cache_hit_writeback_invalidate(zero, 16);
-        int remaining = sram_files[handle].size - sizeof(SRAM_MAGIC);
-        int pos = 0;
-        while(remaining)
-        {
-            int chunk = SRAMFS_MIN(sizeof(zero), remaining);
-            write_sram(zero, sizeof(SRAM_MAGIC) + offset + pos, chunk);
-            remaining -= chunk;
-            pos += chunk;
-        }
+        memset(f->data, 0, f->data_size);
+        f->dirty = true;
     }
     sram_files[handle].offset = 0;
-    return (void *)handle;
+    return (void *)(uintptr_t)handle;
 }
 
 static int __fstat( void *file, struct stat *st )
 {
-    int handle = (uint32_t)file;
+    int handle = (uintptr_t)file;
     st->st_dev = 0;
     st->st_ino = 0;
     st->st_mode = S_IFREG;
@@ -230,7 +387,7 @@ static int __fstat( void *file, struct stat *st )
 
 static int __lseek(void *file, int ptr, int dir)
 {
-    int handle = (uint32_t)file;
+    int handle = (uintptr_t)file;
     int new_offset = sram_files[handle].offset;
 
     if (dir == SEEK_SET)
@@ -260,27 +417,36 @@ static int __lseek(void *file, int ptr, int dir)
     return new_offset;
 }
 
+//End of the SRAM used by the save files. Anything after this is free for other uses.
+uint32_t sramfs_region_end(void)
+{
+    return SRAMFS_BASE + sram_shadow_size;
+}
+
 static int __read( void *file, uint8_t *ptr, int len )
 {
-    int handle = (uint32_t)file;
-    int offset = sram_get_file_start_by_handle(handle) + sram_files[handle].offset + sizeof(SRAM_MAGIC);
-    int max_len = SRAMFS_MIN(len, sram_files[handle].size - offset);
-    read_sram(ptr, offset, max_len);
+    int handle = (uintptr_t)file;
+    sramfs_file_t *f = &sramfs_files[handle];
+    int max_len = SRAMFS_MAX(0, SRAMFS_MIN(len, (int)f->data_size - (int)sram_files[handle].offset));
+    memcpy(ptr, &f->data[sram_files[handle].offset], max_len);
     sram_files[handle].offset += max_len;
     return max_len;
 }
 
 static int __write( void *file, uint8_t *ptr, int len )
 {
-    int handle = (uint32_t)file;
-    int offset = sram_get_file_start_by_handle(handle) + sram_files[handle].offset + sizeof(SRAM_MAGIC);
-    write_sram(ptr, offset, len);
-    sram_files[handle].offset += len;
-    return len;
+    int handle = (uintptr_t)file;
+    sramfs_file_t *f = &sramfs_files[handle];
+    int max_len = SRAMFS_MAX(0, SRAMFS_MIN(len, (int)f->data_size - (int)sram_files[handle].offset));
+    memcpy(&f->data[sram_files[handle].offset], ptr, max_len);
+    f->dirty |= (max_len > 0);
+    sram_files[handle].offset += max_len;
+    return max_len;
 }
 
 static int __close( void *file )
 {
+    sramfs_commit((uintptr_t)file);
     return 0;
 }
 
@@ -301,10 +467,38 @@ int sramfs_init(sram_files_t *files, int num_files)
     assert(files != NULL);
     assert(num_files > 0);
 
-    sram_files = malloc(sizeof(sram_files_t) * (num_files + 1));
-    assert(sram_files != NULL);
+    sram_files = mem_alloc(MEM_TAG_SAVE, sizeof(sram_files_t) * (num_files + 1));
+    sramfs_files = mem_calloc(MEM_TAG_SAVE, num_files + 1, sizeof(sramfs_file_t));
+    assert(sram_files != NULL && sramfs_files != NULL);
     memcpy(&sram_files[1], files, sizeof(sram_files_t) * num_files);
     sram_num_files = num_files;
+
+    //Lay out the slots. The file sizes include the v1 magic number, which v2 does not store.
+    sram_shadow_size = sizeof(sramfs_super_t);
+    for (int i = 1; i <= num_files; i++)
+    {
+        sramfs_file_t *f = &sramfs_files[i];
+        f->data_size = sram_files[i].size - sizeof(SRAM_MAGIC);
+        f->data = mem_calloc(MEM_TAG_SAVE, 1, SRAMFS_ALIGN(f->data_size));
+        assert(f->data != NULL);
+        for (int slot = 0; slot < 2; slot++)
+        {
+            f->slot_offset[slot] = sram_shadow_size;
+            sram_shadow_size += sizeof(sramfs_slot_t) + SRAMFS_ALIGN(f->data_size);
+        }
+    }
+    assert(sram_get_file_start_by_handle(num_files + 1) <= SRAMFS_BASE);
+    assert(SRAMFS_BASE + sram_shadow_size <= SRAMFS_END);
+
+    //Pull the whole region into the RAM shadow up front
+    sram_shadow = mem_memalign(MEM_TAG_SAVE, SRAM_SECTOR_SIZE, sram_shadow_size);
+    assert(sram_shadow != NULL);
+    sram_init();
+    sram_dma_read(sram_shadow, SRAMFS_BASE, sram_shadow_size);
+    sram_dma_wait();
+
+    sramfs_open_region();
+
     int res = attach_filesystem("sram:/", &sram_fs);
     return res;
 }
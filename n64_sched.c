@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include "n64/n64_sched.h"
+#include "n64/n64_idle.h"
+
+//Timestamps of the first and latest vblank, from the VI interrupt. The refresh period is measured from these
+//rather than assumed, so NTSC, PAL and MPAL all work.
+static volatile uint32_t sched_vblanks = 0;
+static volatile uint64_t sched_first_vblank = 0;
+static volatile uint64_t sched_last_vblank = 0;
+static uint64_t sched_deadline = 0;
+
+static uint32_t sched_interval = COSMO_INTERVAL_DEFAULT;
+static uint64_t sched_last_tick = 0;
+static bool sched_behind = false;
+static bool sched_frame_pending = false;
+static uint32_t sched_skipped = 0;
+static uint32_t sched_skipped_total = 0;
+
+static void sched_vi_interrupt(void)
+{
+    uint64_t now = timer_ticks();
+    if (sched_vblanks == 0)
+    {
+        sched_first_vblank = now;
+    }
+    sched_last_vblank = now;
+    sched_vblanks++;
+}
+
+void sched_init(void)
+{
+    static bool initialised = false;
+    if (initialised)
+    {
+        return;
+    }
+    register_VI_handler(sched_vi_interrupt);
+    initialised = true;
+}
+
+uint32_t sched_vblank_count(void)
+{
+    return sched_vblanks;
+}
+
+//Measured refresh period in timer ticks, 0 until two vblanks have been seen
+static uint64_t sched_frame_ticks(uint32_t count, uint64_t last)
+{
+    return (count < 2) ? 0 : (last - sched_first_vblank) / (count - 1);
+}
+
+void sched_wait_until(uint64_t deadline)
+{
+    disable_interrupts();
+    uint32_t count = sched_vblanks;
+    uint64_t last = sched_last_vblank;
+    uint64_t frame = sched_frame_ticks(count, last);
+    enable_interrupts();
+
+    //Nothing to line up with until two vblanks have been seen
+    if (!SCHED_VSYNC || frame == 0 || deadline <= last)
+    {
+        idle_run(deadline);
+        while (timer_ticks() < deadline);
+        return;
+    }
+
+    //The VI interrupt releases the wait. The timeout covers the VI being blanked or reconfigured.
+    uint32_t frames = (deadline - last + frame / 2) / frame;
+    uint32_t target = count + frames;
+    idle_run(last + frames * frame);
+    while ((int32_t)(sched_vblanks - target) < 0 && timer_ticks() < deadline + frame);
+}
+
+void sched_delay(uint32_t ms)
+{
+    sched_wait_until(timer_ticks() + TICKS_FROM_MS(ms));
+}
+
+//Like the original's timer tick counter, so a fade or scroll takes the same time however long each step draws for.
+void sched_wait(uint32_t ms)
+{
+    uint64_t now = timer_ticks();
+    if (sched_deadline == 0 || now > sched_deadline + TICKS_FROM_MS(SCHED_RESYNC_MS))
+    {
+        sched_deadline = now;
+    }
+    sched_deadline += TICKS_FROM_MS(ms);
+    sched_wait_until(sched_deadline);
+}
+
+uint32_t sched_game_interval(void)
+{
+    return sched_interval;
+}
+
+void sched_set_game_interval(uint32_t ms)
+{
+    sched_interval = (ms < SCHED_INTERVAL_MIN) ? SCHED_INTERVAL_MIN : (ms > SCHED_INTERVAL_MAX) ? SCHED_INTERVAL_MAX : ms;
+}
+
+void sched_tick(void)
+{
+    //Waits are released on the nearest vblank, so a tick on time can still be up to a refresh period long.
+    //On top of that an eighth of a tick of slack covers ordinary jitter. However long the gap, it only counts
+    //when nothing called sched_resync in between.
+    disable_interrupts();
+    uint64_t frame = SCHED_VSYNC ? sched_frame_ticks(sched_vblanks, sched_last_vblank) : 0;
+    enable_interrupts();
+    uint64_t now = timer_ticks();
+    uint64_t gap = now - sched_last_tick;
+    uint64_t allowed = TICKS_FROM_MS(sched_interval + sched_interval / 8) + frame;
+    sched_behind = (sched_last_tick != 0 && gap > allowed);
+    sched_last_tick = now;
+    sched_frame_pending = true;
+}
+
+void sched_resync(void)
+{
+    sched_last_tick = 0;
+}
+
+bool sched_skip_frame(void)
+{
+    if (!sched_frame_pending)
+    {
+        return false;
+    }
+    sched_frame_pending = false;
+    if (sched_behind && sched_skipped < SCHED_MAX_FRAME_SKIP)
+    {
+        sched_skipped++;
+        sched_skipped_total++;
+        return true;
+    }
+    if (sched_skipped > 0)
+    {
+        debugf("sched: skipped %lu frames to keep up, %lu so far\n", sched_skipped, sched_skipped_total);
+    }
+    sched_skipped = 0;
+    return false;
+}
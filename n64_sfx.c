@@ -3,11 +3,12 @@
 #include <libdragon.h>
 #include <string.h>
 #include <stdlib.h>
-#include <SDL_timer.h>
 #include "sound/sfx.h"
 #include "sound/audio.h"
-#include "files/file.h"
 #include "game.h"
+#include "n64/n64_audio.h"
+#include "n64/n64_vol.h"
+#include "n64/n64_mem.h"
 
 #define SFX_ADLIB_SAMPLE_RATE 140
 #define PC_PIT_RATE 1193181
@@ -15,23 +16,43 @@
 
 #define SFX_NUM_CHANNELS 1
 #define SFX_BYTES_PER_SAMPLE 2
-#define SFX_AUDIO_SAMPLE_RATE 22050
-#define SFX_CHANNELS 15
+#define SFX_AUDIO_SAMPLE_RATE (audio_get_profile()->sfx_rate)
 
 uint8 sfx_on_flag = 1;
 
+#define SFX_NUM_FILES 3
+
 typedef struct Sfx
 {
     uint8 priority;
     waveform_t wave;
     uint32_t alen;
     int16_t *abuf;
+    const vol_rom_t *rom; //Source of the samples while the sfx is still waiting to be rendered
+    int offset;
+    int num_samples;
 } Sfx;
-static Sfx sfxs[MAX_SAMPLES_PER_FILE * 3];
+static Sfx sfxs[MAX_SAMPLES_PER_FILE * SFX_NUM_FILES];
+static vol_rom_t sfx_roms[SFX_NUM_FILES];
+static int sfx_next_render = 0;
+
+//Each sfx voice owns one mixer channel. Free voices are kept on a stack so finding one is O(1).
+//Voices are only reclaimed from the mixer when the stack runs dry, which bounds the scan to the number of voices.
+typedef struct sfx_voice_t
+{
+    bool active;
+    uint8 priority;
+    uint32_t start_ticks;
+} sfx_voice_t;
+static sfx_voice_t voices[SFX_MAX_VOICES];
+static uint8_t free_voices[SFX_MAX_VOICES];
+static int num_free_voices = 0;
+static int num_voices = 0;
 
 static void sfx_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking)
 {
     Sfx *_sfx = (Sfx *)ctx;
+    uint32_t start = get_ticks();
     int16_t *dst = CachedAddr(samplebuffer_append(sbuf, wlen));
     int16_t *src = &_sfx->abuf[wpos];
     for (int i = 0; i < wlen; i++)
@@ -39,17 +60,17 @@ static void sfx_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool s
         dst[i] = src[i];
     }
     data_cache_hit_writeback_invalidate(dst, SFX_BYTES_PER_SAMPLE * wlen);
+    audio_stats_record(AUDIO_STAT_SFX, get_ticks() - start);
 }
 
-static int get_num_samples(File *file, int offset, int index, int total)
+static int get_num_samples(const vol_rom_t *rom, int offset, int index, int total)
 {
     if (index < total - 1)
     {
-        file_seek(file, (index + 2) * 16);
-        int next_offset = file_read2(file);
+        int next_offset = vol_rom_read16(rom, (index + 2) * 16);
         return ((next_offset - offset) / 2) - 1;
     }
-    return ((file_get_filesize(file) - offset) / 2) - 1;
+    return ((rom->size - offset) / 2) - 1;
 }
 
 static void writeSample(uint8_t *buf, uint16_t index, int16_t sample)
@@ -61,22 +82,44 @@ static void writeSample(uint8_t *buf, uint16_t index, int16_t sample)
     }
 }
 
-static void convert_sfx_to_wave(Sfx *chunk, File *file, int offset, int num_samples)
+//The buffer is allocated straight away so the heap ends up the same however far rendering has got.
+static void alloc_sfx_wave(Sfx *chunk, const vol_rom_t *rom, int offset, int num_samples)
 {
     int sample_length = (SFX_AUDIO_SAMPLE_RATE / SFX_ADLIB_SAMPLE_RATE);
     chunk->alen = num_samples * sample_length * SFX_NUM_CHANNELS;
-    chunk->abuf = (int16_t *)malloc(chunk->alen * SFX_BYTES_PER_SAMPLE);
+    chunk->abuf = (int16_t *)mem_alloc(MEM_TAG_AUDIO, chunk->alen * SFX_BYTES_PER_SAMPLE);
     assert(chunk->abuf != NULL);
+    chunk->rom = rom;
+    chunk->offset = offset;
+    chunk->num_samples = num_samples;
 
-    file_seek(file, offset);
+    waveform_t *header = &chunk->wave;
+    header->bits = SFX_BYTES_PER_SAMPLE * 8;
+    header->channels = SFX_NUM_CHANNELS;
+    header->frequency = SFX_AUDIO_SAMPLE_RATE;
+    header->len = chunk->alen;
+    header->loop_len = 0;
+    header->read = sfx_read;
+    header->ctx = (void *)chunk;
+}
 
+static void convert_sfx_to_wave(Sfx *chunk)
+{
+    if (chunk->rom == NULL)
+    {
+        return;
+    }
+    const vol_rom_t *rom = chunk->rom;
+    int offset = chunk->offset;
+    int num_samples = chunk->num_samples;
+    int sample_length = (SFX_AUDIO_SAMPLE_RATE / SFX_ADLIB_SAMPLE_RATE);
     int16_t *wave_data = chunk->abuf;
 
     int16_t beepWaveVal = WAVE_AMPLITUDE_VALUE;
     uint16_t beepHalfCycleCounter = 0;
     for (int i = 0; i < num_samples; i++)
     {
-        uint16_t sample = file_read2(file);
+        uint16_t sample = vol_rom_read16(rom, offset + i * 2);
         if (sample)
         {
             int freq = PC_PIT_RATE * 2 / sample;
@@ -97,40 +140,114 @@ static void convert_sfx_to_wave(Sfx *chunk, File *file, int offset, int num_samp
             memset(&wave_data[i * sample_length * SFX_NUM_CHANNELS], 0, sample_length * SFX_NUM_CHANNELS * SFX_BYTES_PER_SAMPLE); //silence
         }
     }
-    waveform_t *header = &chunk->wave;
-    header->bits = SFX_BYTES_PER_SAMPLE * 8;
-    header->channels = SFX_NUM_CHANNELS;
-    header->frequency = SFX_AUDIO_SAMPLE_RATE;
-    header->len = chunk->alen;
-    header->loop_len = 0;
-    header->read = sfx_read;
-    header->ctx = (void *)chunk;
+    chunk->rom = NULL;
 }
 
-static int load_sfx_file(const char *filename, int sfx_offset)
+static int load_sfx_file(const char *filename, int file_index, int sfx_offset)
 {
-    File file;
-    open_file(filename, &file);
-    file_seek(&file, 6);
-    int count = file_read2(&file);
+    //The sound files are read in place from the cart rather than copied through DFS
+    vol_rom_t *rom = &sfx_roms[file_index];
+    bool found = vol_rom_open_any(filename, rom);
+    assert(found);
+    int count = vol_rom_read16(rom, 6);
     for (int i = 0; i < MAX_SAMPLES_PER_FILE; i++)
     {
-        file_seek(&file, (i + 1) * 16); //+1 to skip header.
-        int offset = file_read2(&file);
+        int offset = vol_rom_read16(rom, (i + 1) * 16); //+1 to skip header.
         Sfx *sfx = &sfxs[sfx_offset + i];
-        sfx->priority = file_read1(&file);
-        int num_samples = get_num_samples(&file, offset, i, count);
-        convert_sfx_to_wave(sfx, &file, offset, num_samples);
+        sfx->priority = vol_rom_read8(rom, (i + 1) * 16 + 2);
+        int num_samples = get_num_samples(rom, offset, i, count);
+        alloc_sfx_wave(sfx, rom, offset, num_samples);
     }
-    file_close(&file);
     return MAX_SAMPLES_PER_FILE;
 }
 
+static void voice_release(int voice)
+{
+    voices[voice].active = false;
+    free_voices[num_free_voices++] = voice;
+}
+
+static void voices_reset()
+{
+    num_voices = audio_get_profile()->mixer_channels - SFX_FIRST_CHANNEL;
+    assert(num_voices > 0 && num_voices <= SFX_MAX_VOICES);
+    num_free_voices = 0;
+    for (int voice = num_voices - 1; voice >= 0; voice--)
+    {
+        voice_release(voice);
+    }
+}
+
+//Return voices whose sound has finished back to the free stack.
+static void voices_reclaim()
+{
+    for (int voice = 0; voice < num_voices; voice++)
+    {
+        if (voices[voice].active && !mixer_ch_playing(SFX_FIRST_CHANNEL + voice))
+        {
+            voice_release(voice);
+        }
+    }
+}
+
+//Pick the voice to steal for a new sound. The lowest priority voice loses, with the oldest one
+//losing a tie. A sound never steals from a voice with a higher priority than itself.
+static int voice_steal(uint8 priority)
+{
+    uint32_t now = get_ticks();
+    int victim = -1;
+    for (int voice = 0; voice < num_voices; voice++)
+    {
+        if (victim == -1 ||
+            voices[voice].priority < voices[victim].priority ||
+            (voices[voice].priority == voices[victim].priority &&
+             now - voices[voice].start_ticks > now - voices[victim].start_ticks))
+        {
+            victim = voice;
+        }
+    }
+
+    if (voices[victim].priority > priority)
+    {
+        return -1;
+    }
+    mixer_ch_stop(SFX_FIRST_CHANNEL + victim);
+    return victim;
+}
+
+static int voice_alloc(uint8 priority)
+{
+    //Must be called with the audio lock held
+    if (num_free_voices == 0)
+    {
+        voices_reclaim();
+    }
+    if (num_free_voices > 0)
+    {
+        return free_voices[--num_free_voices];
+    }
+    return voice_steal(priority);
+}
+
+//Only the sound headers are read here. The waves are rendered one at a time by sfx_load_step while the game
+//waits at boot, and any sound played before its turn is rendered on the spot.
 void load_sfx()
 {
-    int sfx_offset = load_sfx_file("SOUNDS.MNI", 0);
-    sfx_offset += load_sfx_file("SOUNDS2.MNI", sfx_offset);
-    load_sfx_file("SOUNDS3.MNI", sfx_offset);
+    voices_reset();
+    int sfx_offset = load_sfx_file("SOUNDS.MNI", 0, 0);
+    sfx_offset += load_sfx_file("SOUNDS2.MNI", 1, sfx_offset);
+    load_sfx_file("SOUNDS3.MNI", 2, sfx_offset);
+    sfx_next_render = 0;
+}
+
+bool sfx_load_step(void)
+{
+    if (sfx_next_render == MAX_SAMPLES_PER_FILE * SFX_NUM_FILES)
+    {
+        return false;
+    }
+    convert_sfx_to_wave(&sfxs[sfx_next_render++]);
+    return true;
 }
 
 void play_sfx(int sfx_number)
@@ -138,29 +255,34 @@ void play_sfx(int sfx_number)
     if (!sfx_number)
         return;
 
-    sfx_number--;
-    for (int channel = 2; channel < SFX_CHANNELS; channel++)
+    Sfx *sfx = &sfxs[sfx_number - 1];
+    convert_sfx_to_wave(sfx);
+    audio_lock();
+    int voice = voice_alloc(sfx->priority);
+    if (voice >= 0)
     {
-        if (!mixer_ch_playing(channel))
-        {
-            mixer_ch_play(channel, &sfxs[sfx_number].wave);
-            SDL_Delay(0); //Pump an audio backend update
-            return;
-        }
+        voices[voice].active = true;
+        voices[voice].priority = sfx->priority;
+        voices[voice].start_ticks = get_ticks();
+        mixer_ch_play(SFX_FIRST_CHANNEL + voice, &sfx->wave);
     }
+    audio_unlock();
 }
 
 void sfx_close()
 {
-    for (int channel = 1; channel < SFX_CHANNELS; channel++)
+    audio_lock();
+    for (int voice = 0; voice < num_voices; voice++)
     {
-        mixer_ch_stop(channel);
+        mixer_ch_stop(SFX_FIRST_CHANNEL + voice);
     }
-    for (int i = 0; i < MAX_SAMPLES_PER_FILE * 3; i++)
+    voices_reset();
+    audio_unlock();
+    for (int i = 0; i < MAX_SAMPLES_PER_FILE * SFX_NUM_FILES; i++)
     {
         if (sfxs[i].abuf)
         {
-            free(sfxs[i].abuf);
+            mem_free(MEM_TAG_AUDIO, sfxs[i].abuf);
         }
     }
 }
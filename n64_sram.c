@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <libdragon.h>
+#include <string.h>
+#include "n64/n64_sram.h"
+#include "n64/regsinternal.h"
+
+#define PI_STATUS_DMA_BUSY (1 << 0)
+#define PI_STATUS_IO_BUSY (1 << 1)
+
+typedef struct sram_dma_req_t
+{
+    uint8_t *ram;
+    uint32_t offset;
+    uint32_t len;
+    bool write;
+} sram_dma_req_t;
+
+//Each request is carried out as a series of steps. A step is either a direct DMA of whole sectors within
+//one bank, or a single sector through the bounce buffer. A partial sector write needs the sector read
+//into the bounce buffer first, so it takes two DMAs.
+typedef enum
+{
+    SRAM_STEP_NONE,
+    SRAM_STEP_DIRECT,
+    SRAM_STEP_BOUNCE_READ,
+    SRAM_STEP_BOUNCE_RMW,
+    SRAM_STEP_BOUNCE_WRITE
+} sram_step_t;
+
+static volatile struct PI_regs_s * const PI_regs = (struct PI_regs_s *)0xa4600000;
+
+static sram_dma_req_t sram_queue[SRAM_DMA_QUEUE_SIZE];
+static volatile uint32_t sram_queue_head = 0;
+static volatile uint32_t sram_queue_tail = 0;
+
+static volatile sram_step_t sram_step = SRAM_STEP_NONE;
+static uint32_t sram_step_len = 0;
+static volatile bool sram_step_issued = false;
+static uint8_t sram_bounce[SRAM_SECTOR_SIZE] __attribute__((aligned(16)));
+
+//SRAM is accessed in 32kB banks. The bank is selected by bits 18 and 19 of the PI address.
+static uint32_t sram_pi_address(uint32_t offset)
+{
+    uint32_t bank = offset / SRAM_BANK_SIZE;
+    uint32_t banked_offset = (offset % SRAM_BANK_SIZE) | (bank << 18);
+    return 0x08000000 + (banked_offset & 0x07FFFFFF);
+}
+
+static bool sram_pi_busy(void)
+{
+    return (PI_regs->status & (PI_STATUS_DMA_BUSY | PI_STATUS_IO_BUSY)) != 0;
+}
+
+//Must be called with interrupts disabled. Another PI user may still have a DMA going, e.g. the
+//dma_read_raw_async in vol_rom_decompress starts with interrupts enabled, so wait that out before issuing ours.
+static void sram_pi_start(void *ram, uint32_t offset, uint32_t len, bool write)
+{
+    while (sram_pi_busy())
+    {
+    }
+    MEMORY_BARRIER();
+    PI_regs->ram_address = ram;
+    MEMORY_BARRIER();
+    PI_regs->pi_address = sram_pi_address(offset);
+    MEMORY_BARRIER();
+    if (write)
+    {
+        PI_regs->read_length = len - 1;
+    }
+    else
+    {
+        PI_regs->write_length = len - 1;
+    }
+    MEMORY_BARRIER();
+    sram_step_issued = true;
+}
+
+//Work out and start the next step of the request at the head of the queue.
+static void sram_next_step(void)
+{
+    if (sram_queue_head == sram_queue_tail)
+    {
+        sram_step = SRAM_STEP_NONE;
+        return;
+    }
+
+    sram_dma_req_t *req = &sram_queue[sram_queue_head % SRAM_DMA_QUEUE_SIZE];
+    uint32_t sector_offset = req->offset % SRAM_SECTOR_SIZE;
+
+    if (sector_offset == 0 && ((uint32_t)req->ram % 16) == 0 && req->len >= SRAM_SECTOR_SIZE)
+    {
+        uint32_t bank_left = SRAM_BANK_SIZE - (req->offset % SRAM_BANK_SIZE);
+        sram_step_len = req->len & ~(SRAM_SECTOR_SIZE - 1);
+        if (sram_step_len > bank_left)
+        {
+            sram_step_len = bank_left;
+        }
+        if (req->write)
+        {
+            data_cache_hit_writeback(req->ram, sram_step_len);
+        }
+        else
+        {
+            data_cache_hit_writeback_invalidate(req->ram, sram_step_len);
+        }
+        sram_step = SRAM_STEP_DIRECT;
+        sram_pi_start(req->ram, req->offset, sram_step_len, req->write);
+        return;
+    }
+
+    //Unaligned edge. Go through the bounce sector.
+    sram_step_len = SRAM_SECTOR_SIZE - sector_offset;
+    if (sram_step_len > req->len)
+    {
+        sram_step_len = req->len;
+    }
+    uint32_t sector = req->offset - sector_offset;
+    data_cache_hit_writeback_invalidate(sram_bounce, SRAM_SECTOR_SIZE);
+    if (req->write && sram_step_len == SRAM_SECTOR_SIZE)
+    {
+        memcpy(UncachedAddr(sram_bounce), req->ram, SRAM_SECTOR_SIZE);
+        sram_step = SRAM_STEP_BOUNCE_WRITE;
+        sram_pi_start(sram_bounce, sector, SRAM_SECTOR_SIZE, true);
+    }
+    else
+    {
+        sram_step = req->write ? SRAM_STEP_BOUNCE_RMW : SRAM_STEP_BOUNCE_READ;
+        sram_pi_start(sram_bounce, sector, SRAM_SECTOR_SIZE, false);
+    }
+}
+
+//Finish the step that was in flight and start the next one. Interrupts must be disabled.
+static void sram_step_complete(void)
+{
+    sram_dma_req_t *req = &sram_queue[sram_queue_head % SRAM_DMA_QUEUE_SIZE];
+    uint32_t sector_offset = req->offset % SRAM_SECTOR_SIZE;
+
+    sram_step_issued = false;
+    switch (sram_step)
+    {
+    case SRAM_STEP_NONE:
+        return;
+    case SRAM_STEP_BOUNCE_READ:
+        memcpy(req->ram, UncachedAddr(&sram_bounce[sector_offset]), sram_step_len);
+        break;
+    case SRAM_STEP_BOUNCE_RMW:
+        //Old sector contents are in the bounce buffer, patch in the new bytes and write it back
+        memcpy(UncachedAddr(&sram_bounce[sector_offset]), req->ram, sram_step_len);
+        sram_step = SRAM_STEP_BOUNCE_WRITE;
+        sram_pi_start(sram_bounce, req->offset - sector_offset, SRAM_SECTOR_SIZE, true);
+        return;
+    case SRAM_STEP_DIRECT:
+    case SRAM_STEP_BOUNCE_WRITE:
+        break;
+    }
+
+    req->ram += sram_step_len;
+    req->offset += sram_step_len;
+    req->len -= sram_step_len;
+    if (req->len == 0)
+    {
+        sram_queue_head++;
+    }
+    sram_next_step();
+}
+
+//The PI interrupt is shared with every other PI user (DFS, dma_read, the vol and music async reads), so
+//an idle PI on its own says nothing about our step. Our step is only ever issued on an idle PI, and every
+//other user also waits for the PI to go idle before starting a DMA, so once ours is issued nothing else can
+//be in flight until it has finished. The first idle PI seen after the issue is therefore our transfer.
+static void sram_poll(void)
+{
+    if (sram_step_issued && !sram_pi_busy())
+    {
+        sram_step_complete();
+    }
+}
+
+static void sram_pi_interrupt(void)
+{
+    sram_poll();
+}
+
+static uint32_t sram_dma_submit(uint8_t *ram, uint32_t offset, uint32_t len, bool write)
+{
+    assert(offset + len <= SRAM_SIZE);
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    //Queue is full, wait for a slot to free up
+    while ((sram_queue_tail - sram_queue_head) == SRAM_DMA_QUEUE_SIZE)
+    {
+        disable_interrupts();
+        sram_poll();
+        enable_interrupts();
+    }
+
+    disable_interrupts();
+    sram_dma_req_t *req = &sram_queue[sram_queue_tail % SRAM_DMA_QUEUE_SIZE];
+    req->ram = ram;
+    req->offset = offset;
+    req->len = len;
+    req->write = write;
+    uint32_t ticket = ++sram_queue_tail;
+
+    //Nothing of ours in flight so kick it off now
+    if (sram_step == SRAM_STEP_NONE)
+    {
+        sram_next_step();
+    }
+    enable_interrupts();
+    return ticket;
+}
+
+uint32_t sram_dma_read(void *ram, uint32_t offset, uint32_t len)
+{
+    return sram_dma_submit(ram, offset, len, false);
+}
+
+uint32_t sram_dma_write(const void *ram, uint32_t offset, uint32_t len)
+{
+    return sram_dma_submit((uint8_t *)ram, offset, len, true);
+}
+
+bool sram_dma_busy(void)
+{
+    return sram_queue_head != sram_queue_tail;
+}
+
+void sram_dma_wait(void)
+{
+    //Poll as well as relying on the interrupt, so this also works if the caller has interrupts disabled.
+    while (sram_dma_busy())
+    {
+        disable_interrupts();
+        sram_poll();
+        enable_interrupts();
+    }
+}
+
+//A request leaves the queue once all of its steps are done, so head counts the completed tickets
+void sram_dma_wait_ticket(uint32_t ticket)
+{
+    while ((int32_t)(sram_queue_head - ticket) < 0)
+    {
+        disable_interrupts();
+        sram_poll();
+        enable_interrupts();
+    }
+}
+
+void sram_init(void)
+{
+    static bool initialised = false;
+    if (initialised)
+    {
+        return;
+    }
+    register_PI_handler(sram_pi_interrupt);
+    set_PI_interrupt(1);
+    initialised = true;
+}
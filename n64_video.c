@@ -9,6 +9,11 @@
 #include "input.h"
 #include "b800_font.h"
 #include "rdp.h"
+#include "n64/n64_audio.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_boot.h"
+#include "n64/n64_latency.h"
+#include "n64/n64_sched.h"
 
 #define VideoSurface SDL_Surface
 
@@ -38,14 +43,14 @@ void fade_to_black_speed_3()
 
 bool init_surface(VideoSurface *surface, int width, int height)
 {
-    surface->pixels = memalign(64, width * height);
+    surface->pixels = mem_memalign(MEM_TAG_VIDEO, 64, width * height);
     assert(surface->pixels != NULL);
     surface->w = width;
     surface->h = height;
     surface->pitch = width * sizeof(uint8_t);
 
-    surface->format = (SDL_PixelFormat *)malloc(sizeof(SDL_PixelFormat));
-    surface->format->palette = (SDL_Palette *)malloc(sizeof(SDL_Palette));
+    surface->format = (SDL_PixelFormat *)mem_alloc(MEM_TAG_VIDEO, sizeof(SDL_PixelFormat));
+    surface->format->palette = (SDL_Palette *)mem_alloc(MEM_TAG_VIDEO, sizeof(SDL_Palette));
     surface->format->BytesPerPixel = 1;
 
     return true;
@@ -60,8 +65,8 @@ bool video_init()
     display_width = 320;
     display_height = 240;
 
-    _palette1 = (uint16_t *)memalign(64, sizeof(uint16_t) * 16);
-    _palette2 = (uint16_t *)memalign(64, sizeof(uint16_t) * 16);
+    _palette1 = (uint16_t *)mem_memalign(MEM_TAG_VIDEO, 64, sizeof(uint16_t) * 16);
+    _palette2 = (uint16_t *)mem_memalign(MEM_TAG_VIDEO, 64, sizeof(uint16_t) * 16);
     assert(_palette1 != NULL);
     assert(_palette2 != NULL);
 
@@ -98,14 +103,14 @@ bool video_init()
 void video_shutdown()
 {
     rdp_close();
-    free(_palette1);
-    free(_palette2);
-    free(game_surface.format->palette);
-    free(game_surface.format);
-    free(game_surface.pixels);
-    free(text_surface.format->palette);
-    free(text_surface.format);
-    free(text_surface.pixels);
+    mem_free(MEM_TAG_VIDEO, _palette1);
+    mem_free(MEM_TAG_VIDEO, _palette2);
+    mem_free(MEM_TAG_VIDEO, game_surface.format->palette);
+    mem_free(MEM_TAG_VIDEO, game_surface.format);
+    mem_free(MEM_TAG_VIDEO, game_surface.pixels);
+    mem_free(MEM_TAG_VIDEO, text_surface.format->palette);
+    mem_free(MEM_TAG_VIDEO, text_surface.format);
+    mem_free(MEM_TAG_VIDEO, text_surface.pixels);
 }
 
 void set_text_mode()
@@ -128,6 +133,12 @@ void set_game_mode()
 
 void video_update()
 {
+    //The surface keeps everything drawn, so a skipped frame just shows up in the next one
+    if (sched_skip_frame())
+    {
+        return;
+    }
+
     VideoSurface *src = is_game_mode ? &game_surface : &text_surface;
     uint8_t pal_slot = is_game_mode ? GAME_PALETTE_SLOT : TEXT_PALETTE_SLOT;
     data_cache_hit_writeback_invalidate(src->pixels, src->w * src->h);
@@ -141,8 +152,14 @@ void video_update()
     int chunk_size = x_per_loop * y_per_loop;
     assert(chunk_size <= 2048);
 
+    latency_frame_begin();
     while (!(disp = display_lock()));
+    latency_frame_locked();
 
+    //The mixer queues its RSP work from the AI interrupt through the same rspq write pointer, so it must not run
+    //while a command is half written. See audio_lock for the rest of what it guards. It is only held per batch of
+    //commands, not across the whole frame, so the AI interrupt is never held off for long.
+    audio_lock();
     rdp_attach(disp);
     rdpq_set_other_modes_raw(SOM_CYCLE_COPY | SOM_ENABLE_TLUT_RGB16);
 
@@ -153,10 +170,12 @@ void video_update()
         rdpq_load_tlut(GAME_PALETTE_TILE, 0, 15);
         palette_dirty = false;
     }
+    audio_unlock();
 
     uint8_t *ptr = src->pixels;
     while (current_y < 240)
     {
+        audio_lock();
         // Load the 8bit indexed texture into TEX_TILE with the associated palette
         rdpq_set_tile(TEX_TILE, FMT_CI8, 0x0000, x_per_loop, pal_slot);
         rdpq_set_texture_image(ptr, FMT_CI8, x_per_loop);
@@ -173,10 +192,15 @@ void video_update()
             rdpq_texture_rectangle(TEX_TILE, 0, current_y, x_per_loop, (current_y + y_per_loop), 0, 0, 1, 1);
             current_y += y_per_loop;
         }
+        audio_unlock();
         ptr += chunk_size;
     }
 
+    audio_lock();
     rdp_auto_show_display(disp);
+    audio_unlock();
+    latency_frame_submitted();
+    boot_frame_shown();
 }
 
 void video_draw_tile(Tile *tile, uint16 x, uint16 y)
@@ -0,0 +1,987 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Replaces cosmo-engine's files/vol.c. Instead of scanning an archive's directory on every open, entries are
+//looked up in the prebuilt perfect hash index from tools/mkvolindex, which is read into RAM once.
+//Compressed entries are decoded while their DMA chunks arrive, straight into the caller's buffer.
+
+#define _GNU_SOURCE //fopencookie
+#include <libdragon.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include "files/vol.h"
+#include "n64/n64_vol.h"
+#include "n64/n64_lz.h"
+#include "n64/n64_mem.h"
+#include "n64/n64_cache.h"
+
+#define VOL_DIRECTORY_ENTRIES 200 //4000 byte directory of 20 byte entries
+#define VOL_BOUNCE_SIZE 512
+#define VOL_STREAM_CHUNK 4096
+
+#ifdef __NEWLIB__
+typedef _off64_t vol_off_t;
+#else
+typedef off64_t vol_off_t;
+#endif
+
+static uint8_t *vol_index = NULL;
+static const vol_index_header_t *vol_index_header;
+static const char *vol_index_archives;
+static const uint16_t *vol_index_displacement;
+static const uint16_t *vol_index_slots;
+static const vol_index_entry_t *vol_index_entries;
+static bool vol_index_loaded = false;
+static vol_pi_stats_t vol_pi_stats;
+
+//Every DMA the vol layer starts goes through these so they can be counted
+static void vol_pi_dma(void *ram, uint32_t addr, uint32_t len)
+{
+    vol_pi_stats.dmas++;
+    vol_pi_stats.bytes += len;
+    dma_read(ram, addr, len);
+}
+
+static void vol_pi_dma_async(void *ram, uint32_t addr, uint32_t len)
+{
+    vol_pi_stats.dmas++;
+    vol_pi_stats.bytes += len;
+    dma_read_raw_async(ram, addr, len);
+}
+
+static uint32_t vol_align4(uint32_t size)
+{
+    return (size + 3) & ~3;
+}
+
+//The index is big endian. Fields are converted to native order in place after loading so the host tools
+//can run this file too; on the N64 it is a no-op rewrite.
+static void vol_be16_in_place(void *p)
+{
+    uint8_t *b = p;
+    uint16_t v = (b[0] << 8) | b[1];
+    memcpy(p, &v, sizeof(v));
+}
+
+static void vol_be32_in_place(void *p)
+{
+    uint8_t *b = p;
+    uint32_t v = ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+    memcpy(p, &v, sizeof(v));
+}
+
+static void vol_index_load(void)
+{
+    vol_index_loaded = true;
+
+    int fp = dfs_open(VOL_INDEX_FILENAME);
+    if (fp < 0)
+    {
+        debugf("vol: %s not found, falling back to directory scans\n", VOL_INDEX_FILENAME);
+        return;
+    }
+    int size = dfs_size(fp);
+    vol_index = mem_alloc(MEM_TAG_MISC, size);
+    assert(vol_index != NULL);
+    dfs_read(vol_index, 1, size, fp);
+    dfs_close(fp);
+
+    vol_index_header_t *header = (vol_index_header_t *)vol_index;
+    vol_be32_in_place(&header->magic);
+    vol_be16_in_place(&header->num_archives);
+    vol_be16_in_place(&header->num_entries);
+    vol_be16_in_place(&header->num_buckets);
+    vol_be16_in_place(&header->num_slots);
+    vol_be32_in_place(&header->version);
+    assert(header->magic == VOL_INDEX_MAGIC && header->version == VOL_INDEX_VERSION);
+    vol_index_header = header;
+
+    uint32_t pos = sizeof(vol_index_header_t);
+    vol_index_archives = (const char *)&vol_index[pos];
+    pos += vol_index_header->num_archives * VOL_INDEX_ARCHIVE_LEN;
+    vol_index_displacement = (const uint16_t *)&vol_index[pos];
+    pos += vol_align4(vol_index_header->num_buckets * sizeof(uint16_t));
+    vol_index_slots = (const uint16_t *)&vol_index[pos];
+    pos += vol_align4(vol_index_header->num_slots * sizeof(uint16_t));
+    vol_index_entries = (const vol_index_entry_t *)&vol_index[pos];
+    assert(pos + vol_index_header->num_entries * sizeof(vol_index_entry_t) <= size);
+
+    for (int i = 0; i < vol_index_header->num_buckets; i++)
+    {
+        vol_be16_in_place((void *)&vol_index_displacement[i]);
+    }
+    for (int i = 0; i < vol_index_header->num_slots; i++)
+    {
+        vol_be16_in_place((void *)&vol_index_slots[i]);
+    }
+    for (int i = 0; i < vol_index_header->num_entries; i++)
+    {
+        vol_be32_in_place((void *)&vol_index_entries[i].offset);
+        vol_be32_in_place((void *)&vol_index_entries[i].size);
+        vol_be32_in_place((void *)&vol_index_entries[i].stored_size);
+    }
+}
+
+//Archives are identified by file name, whatever directory or filesystem prefix the game put in front.
+//They all sit in the root of the DFS.
+static const char *vol_basename(const char *vol_filename)
+{
+    const char *base = vol_filename;
+    for (const char *c = vol_filename; *c != '\0'; c++)
+    {
+        if (*c == '/' || *c == ':')
+        {
+            base = c + 1;
+        }
+    }
+    return base;
+}
+
+static int vol_index_archive(const char *vol_filename)
+{
+    const char *base = vol_basename(vol_filename);
+    for (int i = 0; i < vol_index_header->num_archives; i++)
+    {
+        if (strncasecmp(&vol_index_archives[i * VOL_INDEX_ARCHIVE_LEN], base, VOL_INDEX_ARCHIVE_LEN) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool vol_index_find(const char *vol_filename, const char *filename, vol_index_entry_t *found)
+{
+    int archive = vol_index_archive(vol_filename);
+    if (archive < 0 || strlen(filename) > VOL_INDEX_NAME_LEN)
+    {
+        return false;
+    }
+
+    uint32_t bucket = vol_index_bucket(filename, archive, vol_index_header->num_buckets);
+    uint32_t slot = vol_index_slot(filename, archive, vol_index_displacement[bucket], vol_index_header->num_slots);
+    uint16_t index = vol_index_slots[slot];
+    if (index == VOL_INDEX_EMPTY)
+    {
+        return false;
+    }
+
+    //The perfect hash only guarantees no collisions between names that are in the index, so check it really is this one
+    const vol_index_entry_t *entry = &vol_index_entries[index];
+    if (entry->archive != archive || strncasecmp(entry->name, filename, VOL_INDEX_NAME_LEN) != 0)
+    {
+        return false;
+    }
+    *found = *entry;
+    return true;
+}
+
+//Original behaviour, used for archives the index does not cover.
+static bool vol_directory_find(const char *vol_filename, const char *filename, vol_index_entry_t *entry)
+{
+    File vol_file;
+    if (!file_open(vol_filename, "rb", &vol_file))
+    {
+        return false;
+    }
+
+    bool found = false;
+    for (int i = 0; i < VOL_DIRECTORY_ENTRIES && !found; i++)
+    {
+        char name[VOL_INDEX_NAME_LEN + 1] = {0};
+        for (int c = 0; c < VOL_INDEX_NAME_LEN; c++)
+        {
+            name[c] = file_read1(&vol_file);
+        }
+        entry->offset = file_read4(&vol_file);
+        entry->size = file_read4(&vol_file);
+        found = strcasecmp(name, filename) == 0;
+    }
+    file_close(&vol_file);
+    memset(entry->name, 0, VOL_INDEX_NAME_LEN);
+    memcpy(entry->name, filename, strnlen(filename, VOL_INDEX_NAME_LEN));
+    entry->stored_size = entry->size;
+    entry->flags = 0;
+    return found;
+}
+
+static bool vol_find(const char *vol_filename, const char *filename, vol_index_entry_t *entry)
+{
+    if (!vol_index_loaded)
+    {
+        vol_index_load();
+    }
+    if (vol_index != NULL && vol_index_archive(vol_filename) >= 0)
+    {
+        return vol_index_find(vol_filename, filename, entry);
+    }
+    return vol_directory_find(vol_filename, filename, entry);
+}
+
+//Compressed data is DMA'd in chunks into two buffers. The next chunk is read while the current one is decoded.
+//Packed entries are aligned, so the chunks can go straight from the cart without a bounce.
+static bool vol_rom_decompress(uint32_t rom_addr, uint32_t stored_size, uint8_t *dest, uint32_t size)
+{
+    static uint8_t chunk[2][VOL_STREAM_CHUNK] __attribute__((aligned(16)));
+    assert((rom_addr & 1) == 0);
+
+    lz_stream_t stream;
+    lz_stream_init(&stream, dest, size);
+
+    int current = 0;
+    uint32_t pos = 0;
+    uint32_t len = (stored_size < VOL_STREAM_CHUNK) ? stored_size : VOL_STREAM_CHUNK;
+    data_cache_hit_writeback_invalidate(chunk[current], VOL_STREAM_CHUNK);
+    vol_pi_dma_async(chunk[current], rom_addr, (len + 1) & ~1);
+
+    bool ok = true;
+    while (len > 0)
+    {
+        dma_wait();
+        uint32_t next_pos = pos + len;
+        uint32_t next_len = stored_size - next_pos;
+        next_len = (next_len < VOL_STREAM_CHUNK) ? next_len : VOL_STREAM_CHUNK;
+        if (next_len > 0)
+        {
+            data_cache_hit_writeback_invalidate(chunk[current ^ 1], VOL_STREAM_CHUNK);
+            vol_pi_dma_async(chunk[current ^ 1], rom_addr + next_pos, (next_len + 1) & ~1);
+        }
+        ok = ok && lz_stream_feed(&stream, chunk[current], len);
+        pos = next_pos;
+        len = next_len;
+        current ^= 1;
+    }
+    return ok && lz_stream_done(&stream);
+}
+
+#if VOL_LOAD_TIMINGS
+//Time a plain DMA of the stored bytes to get the PI rate for this entry, then scale it to the raw size.
+static void vol_log_timing(const vol_index_entry_t *entry, uint32_t rom_addr, uint32_t ticks)
+{
+    static uint8_t scratch[VOL_STREAM_CHUNK] __attribute__((aligned(16)));
+    uint32_t dma_ticks = 0;
+    if (rom_addr != 0 && (rom_addr & 1) == 0)
+    {
+        uint32_t start = get_ticks();
+        for (uint32_t pos = 0; pos < entry->stored_size; pos += VOL_STREAM_CHUNK)
+        {
+            uint32_t len = entry->stored_size - pos;
+            len = (len < VOL_STREAM_CHUNK) ? len : VOL_STREAM_CHUNK;
+            data_cache_hit_writeback_invalidate(scratch, VOL_STREAM_CHUNK);
+            dma_read(scratch, rom_addr + pos, (len + 1) & ~1);
+        }
+        dma_ticks = get_ticks() - start;
+    }
+    uint64_t raw_ticks = (entry->stored_size > 0) ? (uint64_t)dma_ticks * entry->size / entry->stored_size : 0;
+    debugf("vol: %-12.12s %6lu -> %6lu bytes, load %6lluus, raw DMA %6lluus\n", entry->name,
+           (unsigned long)entry->size, (unsigned long)entry->stored_size,
+           (unsigned long long)TICKS_TO_US(ticks), (unsigned long long)TICKS_TO_US(raw_ticks));
+}
+#endif
+
+//Load the first len bytes of an entry into dest, decompressing if needed.
+static bool vol_entry_load(const char *vol_filename, const vol_index_entry_t *entry, uint8_t *dest, uint32_t len)
+{
+    uint32_t start = get_ticks();
+    uint32_t base = dfs_rom_addr(vol_basename(vol_filename));
+    bool ok = true;
+    if (!(entry->flags & VOL_INDEX_FLAG_LZ))
+    {
+        if (base != 0)
+        {
+            vol_rom_t rom = {base + entry->offset, entry->size};
+            vol_rom_read(&rom, 0, dest, len);
+        }
+        else
+        {
+            File file;
+            ok = file_open_at_offset(vol_filename, "rb", &file, entry->offset, entry->size);
+            if (ok)
+            {
+                ok = file_read_to_buffer(&file, dest, len) == len;
+                file_close(&file);
+            }
+        }
+    }
+    else if (len == entry->size)
+    {
+        assert(base != 0);
+        ok = vol_rom_decompress(base + entry->offset, entry->stored_size, dest, len);
+    }
+    else
+    {
+        //Back references need the whole output, so a partial load goes through a temporary buffer
+        uint8_t *data = mem_alloc(MEM_TAG_MISC, entry->size);
+        assert(data != NULL);
+        ok = vol_entry_load(vol_filename, entry, data, entry->size);
+        memcpy(dest, data, len);
+        mem_free(MEM_TAG_MISC, data);
+    }
+
+    if (!ok)
+    {
+        debugf("vol: failed to load %.12s from %s\n", entry->name, vol_filename);
+    }
+#if VOL_LOAD_TIMINGS
+    vol_log_timing(entry, (base != 0) ? base + entry->offset : 0, get_ticks() - start);
+#else
+    (void)start;
+#endif
+    return ok;
+}
+
+//Staged entries, see vol_prefetch. Each one is carved out of the pool in order and the pool is only reset as
+//a whole, so there is no fragmentation to deal with.
+typedef struct vol_stage_t
+{
+    vol_index_entry_t entry;
+    uint32_t rom_addr;
+    uint8_t *data;
+    uint32_t pos; //Stored bytes read so far
+    lz_stream_t stream;
+    bool failed;
+} vol_stage_t;
+
+static uint8_t vol_prefetch_static_pool[VOL_PREFETCH_MAX_BYTES] __attribute__((aligned(16)));
+static uint8_t *vol_prefetch_pool = NULL;
+static uint32_t vol_prefetch_size = 0;
+static uint32_t vol_prefetch_used = 0;
+static vol_stage_t vol_stages[VOL_PREFETCH_MAX_ENTRIES];
+static int vol_num_stages = 0;
+static void (*vol_load_hook)(const char *filename) = NULL;
+
+static bool vol_stage_done(const vol_stage_t *stage)
+{
+    return stage->failed || stage->pos == stage->entry.stored_size;
+}
+
+static void vol_stage_step(vol_stage_t *stage)
+{
+    static uint8_t chunk[VOL_STREAM_CHUNK] __attribute__((aligned(16)));
+    uint32_t len = stage->entry.stored_size - stage->pos;
+    len = (len < VOL_STREAM_CHUNK) ? len : VOL_STREAM_CHUNK;
+
+    if (stage->entry.flags & VOL_INDEX_FLAG_LZ)
+    {
+        data_cache_hit_writeback_invalidate(chunk, VOL_STREAM_CHUNK);
+        vol_pi_dma(chunk, stage->rom_addr + stage->pos, (len + 1) & ~1);
+        stage->failed = !lz_stream_feed(&stage->stream, chunk, len);
+    }
+    else
+    {
+        vol_rom_t rom = {stage->rom_addr, stage->entry.size};
+        vol_rom_read(&rom, stage->pos, &stage->data[stage->pos], len);
+    }
+    stage->pos += len;
+
+    if (stage->pos == stage->entry.stored_size && (stage->entry.flags & VOL_INDEX_FLAG_LZ))
+    {
+        stage->failed |= !lz_stream_done(&stage->stream);
+    }
+}
+
+static vol_stage_t *vol_stage_find(int archive, const char *filename)
+{
+    for (int i = 0; i < vol_num_stages; i++)
+    {
+        vol_stage_t *stage = &vol_stages[i];
+        if (stage->entry.archive == archive && strncasecmp(stage->entry.name, filename, VOL_INDEX_NAME_LEN) == 0)
+        {
+            return stage;
+        }
+    }
+    return NULL;
+}
+
+//Finish a staged entry if it is still in progress. The data stays in the pool until the next vol_prefetch_clear.
+static const uint8_t *vol_stage_get(const char *vol_filename, const char *filename)
+{
+    if (vol_index == NULL)
+    {
+        return NULL;
+    }
+    vol_stage_t *stage = vol_stage_find(vol_index_archive(vol_filename), filename);
+    if (stage == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t start = get_ticks();
+    bool complete = (stage->pos == stage->entry.stored_size);
+    while (!vol_stage_done(stage))
+    {
+        vol_stage_step(stage);
+    }
+    if (stage->failed)
+    {
+        return NULL;
+    }
+#if VOL_LOAD_TIMINGS
+    debugf("vol: %-12.12s %6lu bytes from prefetch (%s), %6lluus\n", stage->entry.name, (unsigned long)stage->entry.size,
+           complete ? "complete" : "finished now", (unsigned long long)TICKS_TO_US(get_ticks() - start));
+#else
+    (void)start;
+    (void)complete;
+#endif
+    return stage->data;
+}
+
+//Picked on first use, cache_init has run by then
+static void vol_prefetch_pool_init(void)
+{
+    vol_prefetch_pool = cache_put("vol/prefetch", VOL_PREFETCH_CACHED_BYTES);
+    if (vol_prefetch_pool != NULL)
+    {
+        cache_pin(vol_prefetch_pool, true);
+        vol_prefetch_size = VOL_PREFETCH_CACHED_BYTES;
+    }
+    else
+    {
+        vol_prefetch_pool = vol_prefetch_static_pool;
+        vol_prefetch_size = VOL_PREFETCH_MAX_BYTES;
+    }
+}
+
+static bool vol_stage_add(const char *vol_filename, const vol_index_entry_t *entry)
+{
+    if (vol_stage_find(entry->archive, entry->name) != NULL)
+    {
+        return true;
+    }
+
+    uint32_t base = dfs_rom_addr(vol_basename(vol_filename));
+    uint32_t size = (entry->size + 15) & ~15;
+    if (vol_prefetch_pool == NULL)
+    {
+        vol_prefetch_pool_init();
+    }
+    if (base == 0 || vol_num_stages == VOL_PREFETCH_MAX_ENTRIES || vol_prefetch_used + size > vol_prefetch_size)
+    {
+        return false;
+    }
+
+    vol_stage_t *stage = &vol_stages[vol_num_stages++];
+    memset(stage, 0, sizeof(vol_stage_t));
+    stage->entry = *entry;
+    stage->rom_addr = base + entry->offset;
+    stage->data = &vol_prefetch_pool[vol_prefetch_used];
+    vol_prefetch_used += size;
+    lz_stream_init(&stage->stream, stage->data, entry->size);
+    return true;
+}
+
+bool vol_prefetch(const char *filename)
+{
+    if (!vol_index_loaded)
+    {
+        vol_index_load();
+    }
+    if (vol_index == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < vol_index_header->num_archives; i++)
+    {
+        char archive[VOL_INDEX_ARCHIVE_LEN + 1] = {0};
+        memcpy(archive, &vol_index_archives[i * VOL_INDEX_ARCHIVE_LEN], VOL_INDEX_ARCHIVE_LEN);
+        vol_index_entry_t entry;
+        if (vol_index_find(archive, filename, &entry))
+        {
+            return vol_stage_add(archive, &entry);
+        }
+    }
+    return false;
+}
+
+bool vol_prefetch_from(const char *vol_filename, const char *filename)
+{
+    if (!vol_index_loaded)
+    {
+        vol_index_load();
+    }
+    vol_index_entry_t entry;
+    return vol_index != NULL && vol_index_find(vol_filename, filename, &entry) && vol_stage_add(vol_filename, &entry);
+}
+
+bool vol_prefetch_step(void)
+{
+    for (int i = 0; i < vol_num_stages; i++)
+    {
+        if (!vol_stage_done(&vol_stages[i]))
+        {
+            vol_stage_step(&vol_stages[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+const uint8_t *vol_prefetch_peek(const char *filename, uint32_t *size)
+{
+    for (int i = 0; i < vol_num_stages; i++)
+    {
+        vol_stage_t *stage = &vol_stages[i];
+        if (strncasecmp(stage->entry.name, filename, VOL_INDEX_NAME_LEN) == 0 && vol_stage_done(stage) && !stage->failed)
+        {
+            *size = stage->entry.size;
+            return stage->data;
+        }
+    }
+    return NULL;
+}
+
+void vol_prefetch_clear(void)
+{
+    vol_num_stages = 0;
+    vol_prefetch_used = 0;
+}
+
+void vol_set_load_hook(void (*hook)(const char *filename))
+{
+    vol_load_hook = hook;
+}
+
+static void vol_loaded(const char *filename)
+{
+    if (vol_load_hook != NULL)
+    {
+        vol_load_hook(filename);
+    }
+}
+
+//An entry that is already in RAM, in the Expansion Pak cache or the prefetch stage
+static const uint8_t *vol_resident(const char *vol_filename, const vol_index_entry_t *entry)
+{
+    char key[CACHE_KEY_LEN];
+    uint32_t size;
+    cache_make_key(key, vol_basename(vol_filename), entry->name);
+    const uint8_t *data = cache_get(key, &size);
+    return (data != NULL) ? data : vol_stage_get(vol_filename, entry->name);
+}
+
+//Keep a copy of a whole entry that has just been loaded, if the cache is enabled and does not have it yet
+static void vol_cache_put(const char *vol_filename, const vol_index_entry_t *entry, const uint8_t *data)
+{
+    char key[CACHE_KEY_LEN];
+    uint32_t size;
+    cache_make_key(key, vol_basename(vol_filename), entry->name);
+    if (!cache_enabled() || cache_get(key, &size) != NULL)
+    {
+        return;
+    }
+    uint8_t *copy = cache_put(key, entry->size);
+    if (copy != NULL)
+    {
+        memcpy(copy, data, entry->size);
+    }
+}
+
+//Read ahead buffer. Blocks are aligned in cart space, so neighbouring reads, even from the next entry, land in the
+//block that is already loaded.
+typedef struct vol_block_t
+{
+    uint8_t data[VOL_BLOCK_SIZE] __attribute__((aligned(16)));
+    uint32_t rom_addr; //Cart address of data[0]
+    uint32_t len;      //Bytes loaded, 0 if empty
+} vol_block_t;
+
+static bool vol_block_has(const vol_block_t *block, uint32_t addr)
+{
+    return addr - block->rom_addr < block->len;
+}
+
+//Load the block holding addr, stopping at end (the end of the entry being read)
+static void vol_block_fill(vol_block_t *block, uint32_t addr, uint32_t end)
+{
+    uint32_t start = addr & ~(VOL_BLOCK_SIZE - 1);
+    end = (end > addr) ? end : addr + 1;
+    uint32_t len = end - start;
+    len = (len < VOL_BLOCK_SIZE) ? len : VOL_BLOCK_SIZE;
+    data_cache_hit_writeback_invalidate(block->data, VOL_BLOCK_SIZE);
+    vol_pi_dma(block->data, start, (len + 1) & ~1);
+    block->rom_addr = start;
+    block->len = len;
+}
+
+static int vol_cookie_seek(uint32_t *pos, uint32_t size, vol_off_t *offset, int whence)
+{
+    vol_off_t new_pos = *offset;
+    if (whence == SEEK_CUR)
+    {
+        new_pos += *pos;
+    }
+    else if (whence == SEEK_END)
+    {
+        new_pos += size;
+    }
+    if (new_pos < 0 || new_pos > size)
+    {
+        return -1;
+    }
+    *pos = new_pos;
+    *offset = new_pos;
+    return 0;
+}
+
+//Raw entries opened as a File are read through a stdio cookie with its own block, instead of DFS. The engine's
+//loaders seek and read a field at a time; those are now served from RAM and only a block miss goes to the PI.
+typedef struct vol_block_file_t
+{
+    vol_block_t block;
+    vol_rom_t rom;
+    uint32_t pos;
+#if VOL_LOAD_TIMINGS
+    char name[VOL_INDEX_NAME_LEN];
+    vol_pi_stats_t stats_at_open;
+#endif
+} vol_block_file_t;
+
+static void vol_rom_dma(const vol_rom_t *rom, uint32_t offset, void *dest, uint32_t len);
+
+static ssize_t vol_block_read(void *cookie, char *buf, size_t size)
+{
+    vol_block_file_t *file = cookie;
+    uint32_t left = file->rom.size - file->pos;
+    size = (size < left) ? size : left;
+    vol_pi_stats.reads++;
+
+    size_t done = 0;
+    while (done < size)
+    {
+        uint32_t addr = file->rom.rom_addr + file->pos;
+        uint32_t len = size - done;
+        if (vol_block_has(&file->block, addr))
+        {
+            uint32_t avail = file->block.rom_addr + file->block.len - addr;
+            len = (len < avail) ? len : avail;
+            memcpy(&buf[done], &file->block.data[addr - file->block.rom_addr], len);
+        }
+        else if (len >= VOL_BLOCK_SIZE)
+        {
+            //Big reads skip the block and go straight into the caller's buffer
+            vol_rom_dma(&file->rom, file->pos, &buf[done], len);
+        }
+        else
+        {
+            vol_block_fill(&file->block, addr, file->rom.rom_addr + file->rom.size);
+            continue;
+        }
+        done += len;
+        file->pos += len;
+    }
+    return size;
+}
+
+static int vol_block_seek(void *cookie, vol_off_t *offset, int whence)
+{
+    vol_block_file_t *file = cookie;
+    return vol_cookie_seek(&file->pos, file->rom.size, offset, whence);
+}
+
+static int vol_block_close(void *cookie)
+{
+    vol_block_file_t *file = cookie;
+#if VOL_LOAD_TIMINGS
+    debugf("vol: %-12.12s closed, %6lu reads, %4lu PI DMAs\n", file->name,
+           (unsigned long)(vol_pi_stats.reads - file->stats_at_open.reads),
+           (unsigned long)(vol_pi_stats.dmas - file->stats_at_open.dmas));
+#endif
+    mem_free(MEM_TAG_MISC, file);
+    return 0;
+}
+
+static void vol_block_open(File *file, const vol_index_entry_t *entry, uint32_t rom_addr)
+{
+    vol_block_file_t *block_file = mem_memalign(MEM_TAG_MISC, 16, sizeof(vol_block_file_t));
+    assert(block_file != NULL);
+    block_file->block.rom_addr = 0;
+    block_file->block.len = 0;
+    block_file->rom.rom_addr = rom_addr;
+    block_file->rom.size = entry->size;
+    block_file->pos = 0;
+#if VOL_LOAD_TIMINGS
+    memcpy(block_file->name, entry->name, VOL_INDEX_NAME_LEN);
+    block_file->stats_at_open = vol_pi_stats;
+#endif
+
+    cookie_io_functions_t io = {.read = vol_block_read, .seek = vol_block_seek, .close = vol_block_close};
+    file->fp = fopencookie(block_file, "rb", io);
+    assert(file->fp != NULL);
+    //The block already buffers, so stdio does not need to
+    setvbuf(file->fp, NULL, _IONBF, 0);
+    file->size = entry->size;
+    file->pos = 0;
+    file->initial_offset = 0;
+}
+
+//Decompressed entries opened as a File are read from a heap copy through a stdio cookie, so the engine's
+//file_* helpers work on them unchanged. The copy is freed by file_close.
+typedef struct vol_mem_file_t
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+} vol_mem_file_t;
+
+static ssize_t vol_mem_read(void *cookie, char *buf, size_t size)
+{
+    vol_mem_file_t *mem = cookie;
+    uint32_t left = mem->size - mem->pos;
+    size = (size < left) ? size : left;
+    memcpy(buf, &mem->data[mem->pos], size);
+    mem->pos += size;
+    return size;
+}
+
+static int vol_mem_seek(void *cookie, vol_off_t *offset, int whence)
+{
+    vol_mem_file_t *mem = cookie;
+    return vol_cookie_seek(&mem->pos, mem->size, offset, whence);
+}
+
+static int vol_mem_close(void *cookie)
+{
+    vol_mem_file_t *mem = cookie;
+    mem_free(MEM_TAG_MISC, mem->data);
+    mem_free(MEM_TAG_MISC, mem);
+    return 0;
+}
+
+//Takes ownership of data
+static void vol_mem_open(File *file, uint8_t *data, uint32_t size)
+{
+    vol_mem_file_t *mem = mem_alloc(MEM_TAG_MISC, sizeof(vol_mem_file_t));
+    assert(mem != NULL);
+    mem->data = data;
+    mem->size = size;
+    mem->pos = 0;
+
+    cookie_io_functions_t io = {.read = vol_mem_read, .seek = vol_mem_seek, .close = vol_mem_close};
+    file->fp = fopencookie(mem, "rb", io);
+    assert(file->fp != NULL);
+    file->size = size;
+    file->pos = 0;
+    file->initial_offset = 0;
+}
+
+bool vol_file_open(const char *vol_filename, const char *filename, File *file)
+{
+    vol_index_entry_t entry;
+    if (!vol_find(vol_filename, filename, &entry))
+    {
+        return false;
+    }
+
+    //With the cache enabled every entry is read in whole so it can be kept
+    const uint8_t *resident = vol_resident(vol_filename, &entry);
+    if (resident == NULL && !(entry.flags & VOL_INDEX_FLAG_LZ) && !cache_enabled())
+    {
+        uint32_t base = dfs_rom_addr(vol_basename(vol_filename));
+        if (base != 0)
+        {
+            vol_block_open(file, &entry, base + entry.offset);
+        }
+        else if (!file_open_at_offset(vol_filename, "rb", file, entry.offset, entry.size))
+        {
+            return false;
+        }
+        vol_loaded(filename);
+        return true;
+    }
+
+    uint8_t *data = mem_alloc(MEM_TAG_MISC, entry.size);
+    assert(data != NULL);
+    if (resident != NULL)
+    {
+        memcpy(data, resident, entry.size);
+    }
+    else if (!vol_entry_load(vol_filename, &entry, data, entry.size))
+    {
+        mem_free(MEM_TAG_MISC, data);
+        return false;
+    }
+    vol_cache_put(vol_filename, &entry, data);
+    vol_mem_open(file, data, entry.size);
+    vol_loaded(filename);
+    return true;
+}
+
+bool vol_rom_open(const char *vol_filename, const char *filename, vol_rom_t *rom)
+{
+    vol_index_entry_t entry;
+    if (!vol_find(vol_filename, filename, &entry) || (entry.flags & VOL_INDEX_FLAG_LZ))
+    {
+        return false;
+    }
+    uint32_t base = dfs_rom_addr(vol_basename(vol_filename));
+    if (base == 0)
+    {
+        return false;
+    }
+    rom->rom_addr = base + entry.offset;
+    rom->size = entry.size;
+    return true;
+}
+
+bool vol_rom_open_any(const char *filename, vol_rom_t *rom)
+{
+    if (!vol_index_loaded)
+    {
+        vol_index_load();
+    }
+    if (vol_index == NULL)
+    {
+        return false;
+    }
+    for (int i = 0; i < vol_index_header->num_archives; i++)
+    {
+        char archive[VOL_INDEX_ARCHIVE_LEN + 1] = {0};
+        memcpy(archive, &vol_index_archives[i * VOL_INDEX_ARCHIVE_LEN], VOL_INDEX_ARCHIVE_LEN);
+        if (vol_rom_open(archive, filename, rom))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Single byte and field reads share one block. The cart is read only, so it never goes stale.
+static vol_block_t vol_rom_block;
+
+static uint8_t vol_rom_byte(const vol_rom_t *rom, uint32_t offset)
+{
+    uint32_t addr = rom->rom_addr + offset;
+    if (!vol_block_has(&vol_rom_block, addr))
+    {
+        vol_block_fill(&vol_rom_block, addr, rom->rom_addr + rom->size);
+    }
+    return vol_rom_block.data[addr - vol_rom_block.rom_addr];
+}
+
+uint8_t vol_rom_read8(const vol_rom_t *rom, uint32_t offset)
+{
+    vol_pi_stats.reads++;
+    return vol_rom_byte(rom, offset);
+}
+
+uint16_t vol_rom_read16(const vol_rom_t *rom, uint32_t offset)
+{
+    vol_pi_stats.reads++;
+    return vol_rom_byte(rom, offset) | (vol_rom_byte(rom, offset + 1) << 8);
+}
+
+void vol_rom_read(const vol_rom_t *rom, uint32_t offset, void *dest, uint32_t len)
+{
+    vol_pi_stats.reads++;
+    vol_rom_dma(rom, offset, dest, len);
+}
+
+static void vol_rom_dma(const vol_rom_t *rom, uint32_t offset, void *dest, uint32_t len)
+{
+    assert(offset + len <= rom->size);
+    uint8_t *out = dest;
+
+    //PI DMA needs 8 byte aligned RAM. Read single bytes up to that.
+    while (len > 0 && ((uint32_t)out & 7) != 0)
+    {
+        *out++ = vol_rom_byte(rom, offset++);
+        len--;
+    }
+
+    uint32_t addr = rom->rom_addr + offset;
+    if ((addr & 1) == 0)
+    {
+        //Straight into the destination. An odd last byte is read on its own.
+        uint32_t dma_len = len & ~1;
+        if (dma_len > 0)
+        {
+            data_cache_hit_writeback_invalidate(out, dma_len);
+            vol_pi_dma(out, addr, dma_len);
+        }
+        if (len & 1)
+        {
+            out[dma_len] = vol_rom_byte(rom, offset + dma_len);
+        }
+        return;
+    }
+
+    //The cart address is odd while RAM is aligned, so the PI cannot DMA it directly. Go through a bounce buffer
+    //starting one byte early.
+    static uint8_t bounce[VOL_BOUNCE_SIZE + 2] __attribute__((aligned(16)));
+    while (len > 0)
+    {
+        uint32_t chunk = (len < VOL_BOUNCE_SIZE) ? len : VOL_BOUNCE_SIZE;
+        data_cache_hit_writeback_invalidate(bounce, sizeof(bounce));
+        vol_pi_dma(bounce, addr - 1, (chunk + 2) & ~1);
+        memcpy(out, &bounce[1], chunk);
+        out += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+}
+
+unsigned char *vol_file_extract_by_name(const char *vol_filename, const char *filename, uint32 *bytes_read)
+{
+    vol_index_entry_t entry;
+    if (!vol_find(vol_filename, filename, &entry))
+    {
+        return NULL;
+    }
+
+    //Straight from the cart into the buffer the caller keeps
+    unsigned char *data = mem_alloc(MEM_TAG_MISC, entry.size);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    const uint8_t *resident = vol_resident(vol_filename, &entry);
+    if (resident != NULL)
+    {
+        memcpy(data, resident, entry.size);
+    }
+    else if (!vol_entry_load(vol_filename, &entry, data, entry.size))
+    {
+        mem_free(MEM_TAG_MISC, data);
+        return NULL;
+    }
+    vol_cache_put(vol_filename, &entry, data);
+    *bytes_read = entry.size;
+    vol_loaded(filename);
+    return data;
+}
+
+uint32 vol_file_load(const char *vol_filename, const char *filename, unsigned char *buffer, uint32 buffer_size)
+{
+    vol_index_entry_t entry;
+    if (!vol_find(vol_filename, filename, &entry))
+    {
+        return 0;
+    }
+    uint32 len = (entry.size < buffer_size) ? entry.size : buffer_size;
+    const uint8_t *resident = vol_resident(vol_filename, &entry);
+    if (resident != NULL)
+    {
+        memcpy(buffer, resident, len);
+    }
+    else if (!vol_entry_load(vol_filename, &entry, buffer, len))
+    {
+        return 0;
+    }
+    if (len == entry.size)
+    {
+        vol_cache_put(vol_filename, &entry, buffer);
+    }
+    vol_loaded(filename);
+    return len;
+}
+
+void vol_get_pi_stats(vol_pi_stats_t *stats)
+{
+    *stats = vol_pi_stats;
+}
+
+void vol_reset_pi_stats(void)
+{
+    memset(&vol_pi_stats, 0, sizeof(vol_pi_stats));
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Renders every music track and sfx through the port's audio code on a PC and writes them out as WAV files.
+//Prints the render speed and a checksum of each output so audio changes can be benchmarked and
+//regression checked without hardware.
+//The audio profile is fixed at build time, build with AUDIO_PROFILE=AUDIO_PROFILE_LOW_COST etc to render another.
+//Usage: audio_render [-s seconds] [-x] <filesystem dir> <output dir>
+//The filesystem dir is the staged DFS directory (build/filesystem) so it contains MUSIC.BNK.
+
+#include <libdragon.h>
+#include <unistd.h>
+#include "sound/audio.h"
+#include "sound/music.h"
+#include "sound/sfx.h"
+#include "files/file.h"
+#include "game.h"
+#include "n64/n64_audio.h"
+#include "n64/n64_vol.h"
+#include "n64/n64_cache.h"
+#include "vol.h"
+
+#define RENDER_CHUNK 1024
+#define NUM_SFX (MAX_SAMPLES_PER_FILE * 3)
+
+void cosmo_audio_init();
+
+static const char *fs_dir;
+static vol_t vols[2];
+static char vol_paths[2][512];
+
+//The game's open_file lives in game.c, which pulls in the whole engine. This one does the same
+//VOL then STN lookup using the tools' VOL reader.
+bool open_file(const char *filename, File *file)
+{
+    const vol_t *owner;
+    const vol_entry_t *entry = vol_find_any(vols, 2, filename, &owner);
+    if (entry == NULL)
+    {
+        fprintf(stderr, "audio_render: %s not found\n", filename);
+        return false;
+    }
+    return file_open_at_offset(owner->path, "rb", file, entry->offset, entry->size);
+}
+
+static uint32_t fnv1a(const uint8_t *data, uint32_t len)
+{
+    uint32_t hash = 0x811C9DC5;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+static void write_le(FILE *fp, uint32_t val, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        fputc((val >> (i * 8)) & 0xFF, fp);
+    }
+}
+
+static void write_wav(const char *path, const samplebuffer_t *sbuf, int channels, int rate)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "audio_render: could not create %s\n", path);
+        return;
+    }
+    uint32_t data_len = sbuf->num_samples * sbuf->bytes_per_sample;
+    fwrite("RIFF", 1, 4, fp);
+    write_le(fp, 36 + data_len, 4);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    write_le(fp, 16, 4);
+    write_le(fp, 1, 2);
+    write_le(fp, channels, 2);
+    write_le(fp, rate, 4);
+    write_le(fp, rate * sbuf->bytes_per_sample, 4);
+    write_le(fp, sbuf->bytes_per_sample, 2);
+    write_le(fp, 16, 2);
+    fwrite("data", 1, 4, fp);
+    write_le(fp, data_len, 4);
+    //Samples are written in host order, which is what WAV expects on little endian hosts
+    fwrite(sbuf->data, 1, data_len, fp);
+    fclose(fp);
+}
+
+//Pull num_samples from a waveform the same way the mixer does, in RENDER_CHUNK sized reads.
+//Returns the time spent in ticks.
+static uint32_t render_waveform(waveform_t *wave, int num_samples, samplebuffer_t *sbuf)
+{
+    sbuf->bytes_per_sample = wave->channels * wave->bits / 8;
+    sbuf->max_samples = num_samples;
+    sbuf->num_samples = 0;
+    sbuf->data = realloc(sbuf->data, num_samples * sbuf->bytes_per_sample);
+
+    uint32_t start = get_ticks();
+    for (int pos = 0; pos < num_samples; pos += RENDER_CHUNK)
+    {
+        int len = num_samples - pos < RENDER_CHUNK ? num_samples - pos : RENDER_CHUNK;
+        wave->read(wave->ctx, sbuf, pos, len, false);
+    }
+    return get_ticks() - start;
+}
+
+static void report(const char *name, const samplebuffer_t *sbuf, uint32_t ticks, int rate)
+{
+    double secs = (double)TICKS_TO_US(ticks) / 1000000.0;
+    double audio_secs = (double)sbuf->num_samples / rate;
+    printf("%-10s %9d samples %9.3f ms %12.0f samples/s %8.1fx realtime  crc %08x\n", name,
+           sbuf->num_samples, secs * 1000.0, secs > 0 ? sbuf->num_samples / secs : 0.0,
+           secs > 0 ? audio_secs / secs : 0.0, fnv1a(sbuf->data, sbuf->num_samples * sbuf->bytes_per_sample));
+}
+
+static int find_playing_channel()
+{
+    for (int ch = SFX_FIRST_CHANNEL; ch < AUDIO_MIXER_CHANNELS; ch++)
+    {
+        if (host_mixer_ch_waveform(ch) != NULL)
+        {
+            return ch;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 30;
+    bool expanded = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:x")) != -1)
+    {
+        if (opt == 's')
+        {
+            seconds = atoi(optarg);
+        }
+        else if (opt == 'x')
+        {
+            expanded = true;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "Usage: %s [-s seconds] <filesystem dir> <output dir>\n", argv[0]);
+        return 1;
+    }
+    fs_dir = argv[optind];
+    const char *out_dir = argv[optind + 1];
+
+    host_dfs_set_root(fs_dir);
+    snprintf(vol_paths[0], sizeof(vol_paths[0]), "%s/COSMO%d.VOL", fs_dir, HOST_EPISODE);
+    snprintf(vol_paths[1], sizeof(vol_paths[1]), "%s/COSMO.STN", fs_dir);
+    if (vol_load(&vols[0], vol_paths[0]) != 0 || vol_load(&vols[1], vol_paths[1]) != 0)
+    {
+        return 1;
+    }
+
+    //-x runs with the Expansion Pak resident cache, which should not change the output
+    host_set_memory_expanded(expanded);
+    cache_init();
+    cosmo_audio_init();
+    const audio_profile_t *profile = audio_get_profile();
+    printf("Profile %s: music %dHz, sfx %dHz\n", profile->name, profile->music_rate, profile->sfx_rate);
+
+    samplebuffer_t sbuf = {0};
+    char name[32];
+    char path[512];
+    uint32_t total_ticks = 0;
+    uint32_t total_samples = 0;
+
+    for (uint32_t track = 0; track < music_bank_num_tracks(); track++)
+    {
+        if (music_bank_track_length(track) == 0)
+        {
+            continue;
+        }
+        load_music(track);
+        waveform_t *wave = host_mixer_ch_waveform(MUSIC_CHANNEL);
+        uint32_t ticks = render_waveform(wave, seconds * profile->music_rate, &sbuf);
+        stop_music();
+
+        snprintf(name, sizeof(name), "MUSIC%02u", track);
+        report(name, &sbuf, ticks, profile->music_rate);
+        snprintf(path, sizeof(path), "%s/%s.WAV", out_dir, name);
+        write_wav(path, &sbuf, wave->channels, profile->music_rate);
+        total_ticks += ticks;
+        total_samples += sbuf.num_samples;
+    }
+    printf("Music total: %u samples in %.3f ms\n\n", total_samples, TICKS_TO_US(total_ticks) / 1000.0);
+
+    vol_reset_pi_stats();
+    uint32_t start = get_ticks();
+    load_sfx();
+    while (sfx_load_step())
+        ;
+    vol_pi_stats_t pi;
+    vol_get_pi_stats(&pi);
+    printf("load_sfx: %.3f ms, %u reads, %u PI DMAs, %llu bytes\n", TICKS_TO_US(get_ticks() - start) / 1000.0,
+           pi.reads, pi.dmas, (unsigned long long)pi.bytes);
+
+    for (int sfx = 1; sfx <= NUM_SFX; sfx++)
+    {
+        play_sfx(sfx);
+        int ch = find_playing_channel();
+        assert(ch >= 0);
+        waveform_t *wave = host_mixer_ch_waveform(ch);
+        uint32_t ticks = render_waveform(wave, wave->len, &sbuf);
+        mixer_ch_stop(ch);
+
+        snprintf(name, sizeof(name), "SFX%02d", sfx);
+        report(name, &sbuf, ticks, profile->sfx_rate);
+        snprintf(path, sizeof(path), "%s/%s.WAV", out_dir, name);
+        write_wav(path, &sbuf, wave->channels, profile->sfx_rate);
+    }
+
+    free(sbuf.data);
+    vol_free(&vols[0]);
+    vol_free(&vols[1]);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#ifndef _HOST_LIBDRAGON_H
+#define _HOST_LIBDRAGON_H
+
+//Just enough of the libdragon API to build the port's audio and save code on a PC.
+//The mixer here does no mixing; the host tools pull samples from the waveforms directly.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <malloc.h>
+#include "system.h"
+
+#define TICKS_PER_SECOND (93750000 / 2)
+#define TICKS_TO_US(t) ((uint64_t)(t) * 1000000 / TICKS_PER_SECOND)
+#define TICKS_TO_MS(t) ((uint64_t)(t) * 1000 / TICKS_PER_SECOND)
+#define TICKS_FROM_MS(ms) ((uint64_t)(ms) * (TICKS_PER_SECOND / 1000))
+#define TIMER_TICKS(us) ((int)((us) * 46.875))
+#define TF_ONE_SHOT 0
+#define TF_CONTINUOUS 1
+
+#define CachedAddr(x) ((void *)(x))
+#define UncachedAddr(x) ((void *)(x))
+#define MEMORY_BARRIER() __asm__ volatile("" : : : "memory")
+#define data_cache_hit_writeback(addr, len) ((void)(addr), (void)(len))
+#define data_cache_hit_writeback_invalidate(addr, len) ((void)(addr), (void)(len))
+#define data_cache_hit_invalidate(addr, len) ((void)(addr), (void)(len))
+
+#define DEBUG_FEATURE_LOG_ISVIEWER 1
+#define DFS_DEFAULT_LOCATION 0
+#define WAVEFORM_UNKNOWN_LEN 0x7FFFFFFF
+
+typedef struct samplebuffer_t
+{
+    uint8_t *data;
+    int bytes_per_sample;
+    int num_samples;
+    int max_samples;
+} samplebuffer_t;
+
+typedef void (*WaveformRead)(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking);
+
+typedef struct waveform_t
+{
+    const char *name;
+    uint8_t bits;
+    uint8_t channels;
+    float frequency;
+    int len;
+    int loop_len;
+    WaveformRead read;
+    void *ctx;
+} waveform_t;
+
+typedef struct timer_link_t timer_link_t;
+
+void *samplebuffer_append(samplebuffer_t *sbuf, int wlen);
+
+void audio_init(const int frequency, int numbuffers);
+void audio_close(void);
+void audio_set_buffer_callback(void (*fill_buffer_callback)(short *buffer, size_t numsamples));
+int audio_get_buffer_length(void);
+
+void mixer_init(int num_channels);
+void mixer_poll(int16_t *out, int nsamples);
+void mixer_ch_play(int ch, waveform_t *wave);
+void mixer_ch_stop(int ch);
+bool mixer_ch_playing(int ch);
+waveform_t *host_mixer_ch_waveform(int ch);
+
+void timer_init(void);
+timer_link_t *new_timer(int ticks, int flags, void (*callback)(int ovfl));
+void delete_timer(timer_link_t *timer);
+uint32_t get_ticks(void);
+uint32_t get_ticks_ms(void);
+long long timer_ticks(void);
+
+void disable_interrupts(void);
+void enable_interrupts(void);
+
+//Pretend to have the Expansion Pak or not. Defaults to not.
+void host_set_memory_expanded(bool expanded);
+bool is_memory_expanded(void);
+
+void debugf(const char *fmt, ...);
+
+//DFS is backed by a directory on the host. dfs_rom_addr hands out fake PI addresses that dma_read understands.
+void host_dfs_set_root(const char *path);
+int dfs_init(uint32_t base_fs_loc);
+int dfs_open(const char *path);
+int dfs_read(void *buf, int size, int count, uint32_t handle);
+int dfs_seek(uint32_t handle, int offset, int origin);
+int dfs_size(uint32_t handle);
+int dfs_close(uint32_t handle);
+uint32_t dfs_rom_addr(const char *path);
+void dma_read(void *ram_address, unsigned long pi_address, unsigned long len);
+void dma_read_raw_async(void *ram_address, unsigned long pi_address, unsigned long len);
+void dma_wait(void);
+uint32_t io_read(uint32_t pi_address);
+
+#endif
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <stdarg.h>
+#include <time.h>
+#include "libdragon.h"
+
+#define HOST_MAX_CHANNELS 32
+#define HOST_MAX_FILES 16
+#define HOST_MAX_ROM_FILES 8
+#define HOST_MAX_FILESYSTEMS 4
+#define HOST_ROM_BASE 0x10000000
+#define HOST_ROM_SLOT_SIZE 0x01000000
+
+static waveform_t *channels[HOST_MAX_CHANNELS];
+static FILE *files[HOST_MAX_FILES];
+static char dfs_root[256] = ".";
+
+static struct
+{
+    char name[64];
+    uint8_t *data;
+    uint32_t size;
+} rom_files[HOST_MAX_ROM_FILES];
+
+static struct
+{
+    const char *prefix;
+    filesystem_t *fs;
+} filesystems[HOST_MAX_FILESYSTEMS];
+
+void *samplebuffer_append(samplebuffer_t *sbuf, int wlen)
+{
+    assert(sbuf->num_samples + wlen <= sbuf->max_samples);
+    void *ptr = sbuf->data + sbuf->num_samples * sbuf->bytes_per_sample;
+    sbuf->num_samples += wlen;
+    return ptr;
+}
+
+void audio_init(const int frequency, int numbuffers)
+{
+}
+
+void audio_close(void)
+{
+}
+
+void audio_set_buffer_callback(void (*fill_buffer_callback)(short *buffer, size_t numsamples))
+{
+}
+
+int audio_get_buffer_length(void)
+{
+    return 0;
+}
+
+void mixer_init(int num_channels)
+{
+    assert(num_channels <= HOST_MAX_CHANNELS);
+    memset(channels, 0, sizeof(channels));
+}
+
+void mixer_poll(int16_t *out, int nsamples)
+{
+}
+
+void mixer_ch_play(int ch, waveform_t *wave)
+{
+    channels[ch] = wave;
+}
+
+void mixer_ch_stop(int ch)
+{
+    channels[ch] = NULL;
+}
+
+bool mixer_ch_playing(int ch)
+{
+    return channels[ch] != NULL;
+}
+
+waveform_t *host_mixer_ch_waveform(int ch)
+{
+    return channels[ch];
+}
+
+void timer_init(void)
+{
+}
+
+timer_link_t *new_timer(int ticks, int flags, void (*callback)(int ovfl))
+{
+    return NULL;
+}
+
+void delete_timer(timer_link_t *timer)
+{
+}
+
+uint32_t get_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    return (uint32_t)(ns * (TICKS_PER_SECOND / 1000000) / 1000);
+}
+
+uint32_t get_ticks_ms(void)
+{
+    return (uint32_t)TICKS_TO_MS(get_ticks());
+}
+
+long long timer_ticks(void)
+{
+    return get_ticks();
+}
+
+static bool memory_expanded = false;
+
+void host_set_memory_expanded(bool expanded)
+{
+    memory_expanded = expanded;
+}
+
+bool is_memory_expanded(void)
+{
+    return memory_expanded;
+}
+
+void disable_interrupts(void)
+{
+}
+
+void enable_interrupts(void)
+{
+}
+
+void debugf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+void host_dfs_set_root(const char *path)
+{
+    snprintf(dfs_root, sizeof(dfs_root), "%s", path);
+}
+
+static FILE *host_fopen(const char *path)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), "%s/%s", dfs_root, path);
+    return fopen(full_path, "rb");
+}
+
+int dfs_init(uint32_t base_fs_loc)
+{
+    return 0;
+}
+
+int dfs_open(const char *path)
+{
+    for (int i = 0; i < HOST_MAX_FILES; i++)
+    {
+        if (files[i] == NULL)
+        {
+            files[i] = host_fopen(path);
+            return files[i] ? i : -1;
+        }
+    }
+    return -1;
+}
+
+int dfs_read(void *buf, int size, int count, uint32_t handle)
+{
+    return (int)fread(buf, 1, size * count, files[handle]);
+}
+
+int dfs_seek(uint32_t handle, int offset, int origin)
+{
+    return fseek(files[handle], offset, origin);
+}
+
+int dfs_size(uint32_t handle)
+{
+    long pos = ftell(files[handle]);
+    fseek(files[handle], 0, SEEK_END);
+    long size = ftell(files[handle]);
+    fseek(files[handle], pos, SEEK_SET);
+    return (int)size;
+}
+
+int dfs_close(uint32_t handle)
+{
+    fclose(files[handle]);
+    files[handle] = NULL;
+    return 0;
+}
+
+uint32_t dfs_rom_addr(const char *path)
+{
+    int slot;
+    for (slot = 0; slot < HOST_MAX_ROM_FILES && rom_files[slot].data; slot++)
+    {
+        if (strcmp(rom_files[slot].name, path) == 0)
+        {
+            return HOST_ROM_BASE + slot * HOST_ROM_SLOT_SIZE;
+        }
+    }
+    assert(slot < HOST_MAX_ROM_FILES);
+
+    FILE *fp = host_fopen(path);
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    rom_files[slot].size = (uint32_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    assert(rom_files[slot].size < HOST_ROM_SLOT_SIZE);
+    //Pad the end like a real cart so reads that run past the file stay in bounds
+    rom_files[slot].data = calloc(1, rom_files[slot].size + 4096);
+    fread(rom_files[slot].data, 1, rom_files[slot].size, fp);
+    fclose(fp);
+    snprintf(rom_files[slot].name, sizeof(rom_files[slot].name), "%s", path);
+    return HOST_ROM_BASE + slot * HOST_ROM_SLOT_SIZE;
+}
+
+void dma_read(void *ram_address, unsigned long pi_address, unsigned long len)
+{
+    uint32_t slot = (pi_address - HOST_ROM_BASE) / HOST_ROM_SLOT_SIZE;
+    uint32_t offset = (pi_address - HOST_ROM_BASE) % HOST_ROM_SLOT_SIZE;
+    assert(slot < HOST_MAX_ROM_FILES && rom_files[slot].data != NULL);
+    assert(offset + len <= rom_files[slot].size + 4096);
+    memcpy(ram_address, rom_files[slot].data + offset, len);
+}
+
+//Transfers finish immediately on the host
+void dma_read_raw_async(void *ram_address, unsigned long pi_address, unsigned long len)
+{
+    dma_read(ram_address, pi_address, len);
+}
+
+void dma_wait(void)
+{
+}
+
+//Words come back big endian, like the real PI bus
+uint32_t io_read(uint32_t pi_address)
+{
+    uint8_t b[4];
+    dma_read(b, pi_address, sizeof(b));
+    return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+int attach_filesystem(const char * const prefix, filesystem_t *filesystem)
+{
+    for (int i = 0; i < HOST_MAX_FILESYSTEMS; i++)
+    {
+        if (filesystems[i].prefix == NULL || strcmp(filesystems[i].prefix, prefix) == 0)
+        {
+            filesystems[i].prefix = prefix;
+            filesystems[i].fs = filesystem;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+filesystem_t *host_get_filesystem(const char *prefix)
+{
+    for (int i = 0; i < HOST_MAX_FILESYSTEMS && filesystems[i].prefix != NULL; i++)
+    {
+        if (strcmp(filesystems[i].prefix, prefix) == 0)
+        {
+            return filesystems[i].fs;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include "libdragon.h"
+#include "sram_emu.h"
+#include "n64/n64_sram.h"
+
+static uint8_t sram[SRAM_SIZE];
+static sram_emu_stats_t stats;
+static int writes_left = -1;
+
+static void sram_emu_dma(uint8_t *ram, uint32_t offset, uint32_t len, bool write)
+{
+    //A single DMA never crosses a bank on the real hardware
+    assert(offset / SRAM_BANK_SIZE == (offset + len - 1) / SRAM_BANK_SIZE);
+    if (write)
+    {
+        stats.write_dmas++;
+        stats.bytes_written += len;
+        if (writes_left >= 0)
+        {
+            len = ((int)len > writes_left) ? (uint32_t)writes_left : len;
+            writes_left -= len;
+        }
+        memcpy(&sram[offset], ram, len);
+    }
+    else
+    {
+        stats.read_dmas++;
+        stats.bytes_read += len;
+        memcpy(ram, &sram[offset], len);
+    }
+}
+
+static void sram_emu_transfer(uint8_t *ram, uint32_t offset, uint32_t len, bool write)
+{
+    assert(offset + len <= SRAM_SIZE);
+    while (len > 0)
+    {
+        uint32_t sector_offset = offset % SRAM_SECTOR_SIZE;
+        uint32_t step;
+        if (sector_offset == 0 && ((uintptr_t)ram % 16) == 0 && len >= SRAM_SECTOR_SIZE)
+        {
+            uint32_t bank_left = SRAM_BANK_SIZE - (offset % SRAM_BANK_SIZE);
+            step = len & ~(SRAM_SECTOR_SIZE - 1);
+            step = (step > bank_left) ? bank_left : step;
+            sram_emu_dma(ram, offset, step, write);
+        }
+        else
+        {
+            uint8_t bounce[SRAM_SECTOR_SIZE];
+            step = SRAM_SECTOR_SIZE - sector_offset;
+            step = (step > len) ? len : step;
+            if (!write || step != SRAM_SECTOR_SIZE)
+            {
+                sram_emu_dma(bounce, offset - sector_offset, SRAM_SECTOR_SIZE, false);
+            }
+            if (write)
+            {
+                memcpy(&bounce[sector_offset], ram, step);
+                sram_emu_dma(bounce, offset - sector_offset, SRAM_SECTOR_SIZE, true);
+            }
+            else
+            {
+                memcpy(ram, &bounce[sector_offset], step);
+            }
+        }
+        ram += step;
+        offset += step;
+        len -= step;
+    }
+}
+
+void sram_init(void)
+{
+}
+
+static uint32_t sram_emu_tickets = 0;
+
+uint32_t sram_dma_read(void *ram, uint32_t offset, uint32_t len)
+{
+    sram_emu_transfer(ram, offset, len, false);
+    return ++sram_emu_tickets;
+}
+
+uint32_t sram_dma_write(const void *ram, uint32_t offset, uint32_t len)
+{
+    sram_emu_transfer((uint8_t *)ram, offset, len, true);
+    return ++sram_emu_tickets;
+}
+
+bool sram_dma_busy(void)
+{
+    return false;
+}
+
+void sram_dma_wait(void)
+{
+}
+
+void sram_dma_wait_ticket(uint32_t ticket)
+{
+    (void)ticket;
+}
+
+void sram_emu_get_stats(sram_emu_stats_t *out)
+{
+    *out = stats;
+}
+
+void sram_emu_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint8_t *sram_emu_data(void)
+{
+    return sram;
+}
+
+void sram_emu_fail_after(int n)
+{
+    writes_left = n;
+}
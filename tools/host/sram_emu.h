@@ -0,0 +1,27 @@
+#ifndef _HOST_SRAM_EMU_H
+#define _HOST_SRAM_EMU_H
+
+#include <stdint.h>
+
+//Memory backed stand in for n64_sram.c. Transfers complete immediately, but are split into the same
+//PI DMAs the real driver would issue (bank splits, bounce sectors and read/modify/write for partial sectors)
+//so the counters match what the cart would see.
+typedef struct sram_emu_stats_t
+{
+    uint32_t read_dmas;
+    uint32_t write_dmas;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} sram_emu_stats_t;
+
+void sram_emu_get_stats(sram_emu_stats_t *stats);
+void sram_emu_reset_stats(void);
+
+//Raw access to the emulated SRAM contents
+uint8_t *sram_emu_data(void);
+
+//Drop every byte written after the next n of them, like the power being cut. The cut can land part way
+//through a DMA, so a run of sectors or a slot header is left half written. Pass -1 to disable.
+void sram_emu_fail_after(int n);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _HOST_SYSTEM_H
+#define _HOST_SYSTEM_H
+
+//libdragon's newlib filesystem hooks, so port filesystems can be attached and driven on a PC.
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+typedef struct dir_t dir_t;
+
+typedef struct filesystem_t
+{
+    void *(*open)(char *name, int flags);
+    int (*fstat)(void *file, struct stat *st);
+    int (*lseek)(void *file, int ptr, int dir);
+    int (*read)(void *file, uint8_t *ptr, int len);
+    int (*write)(void *file, uint8_t *ptr, int len);
+    int (*close)(void *file);
+    int (*unlink)(char *name);
+    int (*findfirst)(char *path, dir_t *dir);
+    int (*findnext)(dir_t *dir);
+} filesystem_t;
+
+int attach_filesystem(const char * const prefix, filesystem_t *filesystem);
+
+//Host only. Returns the filesystem attached at prefix so tools can call its hooks directly.
+filesystem_t *host_get_filesystem(const char *prefix);
+
+#endif
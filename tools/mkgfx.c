@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Converts the game's planar EGA tilesets and fullscreen images into the 8bpp layout the N64 port draws from,
+//so the conversion does not have to run on every boot and level load.
+//Usage: mkgfx <out.vol> <vol/stn files...> -- <name:solid|masked|font|image>...
+//The output is a VOL archive holding each converted asset under its original name. See n64/n64_gfx.h.
+//
+//Source formats:
+//  solid tiles: 32 bytes per 8x8 tile, each row is the blue, green, red and intensity planes
+//  masked tiles: 40 bytes per tile, each row is a mask plane (1 = transparent) followed by the four colour planes
+//  fullscreen images: four 8000 byte planes (blue, green, red, intensity) of 320x200 pixels
+//The leftmost pixel is the most significant bit.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vol.h"
+#include "n64/n64_gfx.h"
+
+#define MAX_VOLS 4
+#define MAX_ASSETS 32
+#define DIRECTORY_SIZE (200 * VOL_ENTRY_SIZE)
+#define GFX_ALIGN 16
+
+typedef struct asset_t
+{
+    char name[VOL_NAME_LEN + 1];
+    uint8_t *data;
+    uint32_t size;
+} asset_t;
+
+static uint8_t plane_pixel(const uint8_t *planes, uint32_t stride, int x)
+{
+    uint8_t colour = 0;
+    for (int p = 0; p < 4; p++)
+    {
+        colour |= ((planes[p * stride + x / 8] >> (7 - (x % 8))) & 1) << p;
+    }
+    return colour;
+}
+
+static uint8_t *convert_tiles(const uint8_t *src, uint32_t size, int type, uint32_t *out_size)
+{
+    bool masked = (type != GFX_TYPE_SOLID);
+    uint32_t row_bytes = masked ? 5 : 4;
+    uint32_t tile_bytes = row_bytes * 8;
+    uint32_t num_tiles = size / tile_bytes;
+
+    *out_size = num_tiles * GFX_TILE_SIZE;
+    uint8_t *out = malloc(*out_size);
+    for (uint32_t t = 0; t < num_tiles; t++)
+    {
+        uint8_t *tile = &out[t * GFX_TILE_SIZE];
+        put_be32(tile, type);
+        uint8_t *pixel = &tile[4];
+        for (int y = 0; y < 8; y++)
+        {
+            const uint8_t *row = &src[t * tile_bytes + y * row_bytes];
+            const uint8_t *planes = masked ? &row[1] : row;
+            for (int x = 0; x < 8; x++)
+            {
+                bool transparent = masked && ((row[0] >> (7 - x)) & 1);
+                *pixel++ = transparent ? GFX_TRANSPARENT : plane_pixel(planes, 1, x);
+            }
+        }
+    }
+    return out;
+}
+
+static uint8_t *convert_image(const uint8_t *src, uint32_t size, uint32_t *out_size)
+{
+    const uint32_t stride = GFX_IMAGE_SIZE / 8;
+    if (size < stride * 4)
+    {
+        return NULL;
+    }
+    *out_size = GFX_IMAGE_SIZE;
+    uint8_t *out = malloc(GFX_IMAGE_SIZE);
+    for (uint32_t y = 0; y < 200; y++)
+    {
+        for (uint32_t x = 0; x < 320; x++)
+        {
+            out[y * 320 + x] = plane_pixel(&src[y * 40], stride, x);
+        }
+    }
+    return out;
+}
+
+static void put_le32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+    dst[2] = val >> 16;
+    dst[3] = val >> 24;
+}
+
+int main(int argc, char **argv)
+{
+    vol_t vols[MAX_VOLS];
+    asset_t assets[MAX_ASSETS];
+    int num_vols = 0;
+    int num_assets = 0;
+    int arg = 2;
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <out.vol> <vol files...> -- <name:solid|masked|font|image>...\n", argv[0]);
+        return 1;
+    }
+
+    for (; arg < argc && strcmp(argv[arg], "--") != 0; arg++)
+    {
+        if (num_vols == MAX_VOLS || vol_load(&vols[num_vols], argv[arg]) != 0)
+        {
+            return 1;
+        }
+        num_vols++;
+    }
+    arg++;
+
+    for (; arg < argc && num_assets < MAX_ASSETS; arg++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%s", argv[arg]);
+        char *kind = strchr(name, ':');
+        if (kind == NULL)
+        {
+            fprintf(stderr, "%s: missing type\n", argv[arg]);
+            return 1;
+        }
+        *kind++ = '\0';
+
+        const vol_t *owner;
+        const vol_entry_t *entry = vol_find_any(vols, num_vols, name, &owner);
+        if (entry == NULL)
+        {
+            printf("mkgfx: %s not found, skipping\n", name);
+            continue;
+        }
+
+        const uint8_t *src = &owner->data[entry->offset];
+        asset_t *asset = &assets[num_assets];
+        snprintf(asset->name, sizeof(asset->name), "%s", entry->name);
+        if (strcmp(kind, "image") == 0)
+        {
+            asset->data = convert_image(src, entry->size, &asset->size);
+        }
+        else if (strcmp(kind, "solid") == 0)
+        {
+            asset->data = convert_tiles(src, entry->size, GFX_TYPE_SOLID, &asset->size);
+        }
+        else if (strcmp(kind, "masked") == 0)
+        {
+            asset->data = convert_tiles(src, entry->size, GFX_TYPE_TRANSPARENT, &asset->size);
+        }
+        else if (strcmp(kind, "font") == 0)
+        {
+            asset->data = convert_tiles(src, entry->size, GFX_TYPE_FONT, &asset->size);
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown type %s\n", name, kind);
+            return 1;
+        }
+        if (asset->data == NULL)
+        {
+            fprintf(stderr, "%s: too small for a %s\n", name, kind);
+            return 1;
+        }
+        num_assets++;
+    }
+
+    //Same directory layout as the game's archives so mkvolindex can index and pack it
+    uint32_t size = DIRECTORY_SIZE;
+    for (int i = 0; i < num_assets; i++)
+    {
+        size += (assets[i].size + GFX_ALIGN - 1) & ~(GFX_ALIGN - 1);
+    }
+    uint8_t *out = calloc(size, 1);
+    uint32_t offset = DIRECTORY_SIZE;
+    for (int i = 0; i < num_assets; i++)
+    {
+        uint8_t *dir = &out[i * VOL_ENTRY_SIZE];
+        memcpy(dir, assets[i].name, strlen(assets[i].name));
+        put_le32(&dir[VOL_NAME_LEN], offset);
+        put_le32(&dir[VOL_NAME_LEN + 4], assets[i].size);
+        memcpy(&out[offset], assets[i].data, assets[i].size);
+        offset += (assets[i].size + GFX_ALIGN - 1) & ~(GFX_ALIGN - 1);
+        free(assets[i].data);
+    }
+
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL || fwrite(out, 1, size, fp) != size)
+    {
+        fprintf(stderr, "Could not write %s\n", argv[1]);
+        return 1;
+    }
+    fclose(fp);
+    printf("%s: %d assets, %u bytes\n", argv[1], num_assets, size);
+
+    free(out);
+    for (int i = 0; i < num_vols; i++)
+    {
+        vol_free(&vols[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Packs the game's music tracks into a single bank that the N64 streams straight from ROM.
+//Usage: mkmusicbank <out.bnk> <vol/stn files...> -- <track names in music index order...>
+//
+//Layout (big endian):
+//  uint32 magic 'MBNK'
+//  uint32 number of tracks
+//  struct { uint32 offset; uint32 length; } tracks[number of tracks]
+//  track data, each one aligned to MUSIC_BANK_ALIGN bytes
+//Tracks that are not in this episode get a zero length entry.
+
+#include <stdlib.h>
+#include <string.h>
+#include "vol.h"
+
+#define MUSIC_BANK_MAGIC 0x4D424E4B
+#define MUSIC_BANK_ALIGN 16
+#define MAX_VOLS 4
+
+int main(int argc, char **argv)
+{
+    vol_t vols[MAX_VOLS];
+    int num_vols = 0;
+    int arg = 2;
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <out.bnk> <vol files...> -- <tracks...>\n", argv[0]);
+        return 1;
+    }
+
+    for (; arg < argc && strcmp(argv[arg], "--") != 0; arg++)
+    {
+        if (num_vols == MAX_VOLS || vol_load(&vols[num_vols], argv[arg]) != 0)
+        {
+            return 1;
+        }
+        num_vols++;
+    }
+    arg++;
+
+    int num_tracks = argc - arg;
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL || num_tracks <= 0)
+    {
+        fprintf(stderr, "Could not create %s\n", argv[1]);
+        return 1;
+    }
+
+    uint32_t offset = 8 + num_tracks * 8;
+    offset = (offset + MUSIC_BANK_ALIGN - 1) & ~(MUSIC_BANK_ALIGN - 1);
+
+    write_be32(fp, MUSIC_BANK_MAGIC);
+    write_be32(fp, num_tracks);
+    for (int i = 0; i < num_tracks; i++)
+    {
+        const vol_t *owner;
+        const vol_entry_t *entry = vol_find_any(vols, num_vols, argv[arg + i], &owner);
+        uint32_t length = entry ? entry->size : 0;
+        write_be32(fp, length ? offset : 0);
+        write_be32(fp, length);
+        offset += (length + MUSIC_BANK_ALIGN - 1) & ~(MUSIC_BANK_ALIGN - 1);
+    }
+    write_pad(fp, MUSIC_BANK_ALIGN);
+
+    for (int i = 0; i < num_tracks; i++)
+    {
+        const vol_t *owner;
+        const vol_entry_t *entry = vol_find_any(vols, num_vols, argv[arg + i], &owner);
+        if (entry == NULL)
+        {
+            printf("mkmusicbank: %s not found, skipping\n", argv[arg + i]);
+            continue;
+        }
+        fwrite(&owner->data[entry->offset], 1, entry->size, fp);
+        write_pad(fp, MUSIC_BANK_ALIGN);
+    }
+
+    fclose(fp);
+    for (int i = 0; i < num_vols; i++)
+    {
+        vol_free(&vols[i]);
+    }
+    return 0;
+}
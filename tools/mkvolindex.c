@@ -0,0 +1,397 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Builds the perfect hash index the N64 uses to find files in the VOL/STN archives.
+//Usage: mkvolindex [-z <pack dir>] [-k <name>]... <out.bin> <vol/stn files...>
+//The archives are numbered in the order given and identified at runtime by file name.
+//With -z the archives are also rewritten into the pack dir with their entries LZ compressed, and the index
+//points into those instead. -k keeps an entry raw, for files the N64 reads in place from ROM.
+//See n64/n64_vol.h for the layout.
+
+#define _GNU_SOURCE //qsort_r
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "vol.h"
+#include "n64/n64_vol.h"
+#include "n64/n64_lz.h"
+
+#define MAX_VOLS 4
+#define MAX_KEEP_RAW 16
+#define MAX_DISPLACEMENT 0xFFFF
+#define PACK_DIRECTORY_SIZE (200 * VOL_ENTRY_SIZE)
+
+//Entries smaller than this are not worth a decoder call, and compression has to save an eighth to pay for itself
+#define PACK_MIN_SIZE 64
+#define PACK_MIN_SAVING(size) ((size) / 8)
+
+typedef struct index_key_t
+{
+    const vol_entry_t *entry;
+    uint8_t archive;
+    uint32_t bucket;
+    uint32_t offset;
+    uint32_t stored_size;
+    uint8_t flags;
+    uint8_t *stored; //Packed data, or NULL to copy the original
+} index_key_t;
+
+typedef struct pack_t
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t raw_size;
+} pack_t;
+
+static int bucket_size_cmp(const void *a, const void *b, void *sizes)
+{
+    uint32_t sa = ((uint32_t *)sizes)[*(const uint32_t *)a];
+    uint32_t sb = ((uint32_t *)sizes)[*(const uint32_t *)b];
+    return (sa < sb) - (sa > sb);
+}
+
+static void write_be16(FILE *fp, uint16_t val)
+{
+    uint8_t b[2];
+    put_be16(b, val);
+    fwrite(b, 1, 2, fp);
+}
+
+static void upper_name(char *dst, const char *src)
+{
+    memset(dst, 0, VOL_INDEX_NAME_LEN);
+    for (int i = 0; i < VOL_INDEX_NAME_LEN && src[i] != '\0'; i++)
+    {
+        dst[i] = (src[i] >= 'a' && src[i] <= 'z') ? src[i] - 'a' + 'A' : src[i];
+    }
+}
+
+static void put_le32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+    dst[2] = val >> 16;
+    dst[3] = val >> 24;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *base = strrchr(path, '/');
+    return base ? base + 1 : path;
+}
+
+//Compress one entry. It stays raw if it is on the keep list or does not shrink enough.
+static void pack_entry(index_key_t *key, const vol_t *vol, char **keep_raw, int num_keep_raw)
+{
+    const uint8_t *src = &vol->data[key->entry->offset];
+    uint32_t size = key->entry->size;
+    key->stored_size = size;
+    key->flags = 0;
+    key->stored = NULL;
+
+    for (int i = 0; i < num_keep_raw; i++)
+    {
+        if (strcasecmp(keep_raw[i], key->entry->name) == 0)
+        {
+            return;
+        }
+    }
+    if (size < PACK_MIN_SIZE)
+    {
+        return;
+    }
+
+    uint8_t *packed = malloc(LZ_COMPRESS_BOUND(size));
+    uint32_t packed_size = lz_compress(src, size, packed, LZ_COMPRESS_BOUND(size));
+    if (packed_size == 0 || packed_size > size - PACK_MIN_SAVING(size))
+    {
+        free(packed);
+        return;
+    }
+
+    //Never ship something the N64 decoder would choke on
+    uint8_t *check = malloc(size);
+    if (lz_decompress(packed, packed_size, check, size) != size || memcmp(check, src, size) != 0)
+    {
+        fprintf(stderr, "%s: %s did not survive a round trip, storing it raw\n", vol->path, key->entry->name);
+        free(check);
+        free(packed);
+        return;
+    }
+    free(check);
+    key->stored = packed;
+    key->stored_size = packed_size;
+    key->flags = VOL_INDEX_FLAG_LZ;
+}
+
+//Lay out a packed copy of one archive: a directory the same shape as the original, then the entries
+//each aligned for DMA. Offsets and sizes in the directory are the stored ones.
+static void pack_archive(pack_t *pack, const vol_t *vol, uint8_t archive, index_key_t *keys, int num_keys)
+{
+    uint32_t size = PACK_DIRECTORY_SIZE;
+    int num_dir = 0;
+    for (int k = 0; k < num_keys; k++)
+    {
+        if (keys[k].archive != archive)
+        {
+            continue;
+        }
+        keys[k].offset = size;
+        size = (size + keys[k].stored_size + VOL_PACK_ALIGN - 1) & ~(VOL_PACK_ALIGN - 1);
+    }
+
+    pack->data = calloc(size, 1);
+    pack->size = size;
+    pack->raw_size = vol->size;
+    for (int k = 0; k < num_keys; k++)
+    {
+        if (keys[k].archive != archive)
+        {
+            continue;
+        }
+        if (num_dir * VOL_ENTRY_SIZE < PACK_DIRECTORY_SIZE)
+        {
+            uint8_t *dir = &pack->data[num_dir * VOL_ENTRY_SIZE];
+            upper_name((char *)dir, keys[k].entry->name);
+            put_le32(&dir[VOL_NAME_LEN], keys[k].offset);
+            put_le32(&dir[VOL_NAME_LEN + 4], keys[k].stored_size);
+            num_dir++;
+        }
+        memcpy(&pack->data[keys[k].offset], keys[k].stored ? keys[k].stored : &vol->data[keys[k].entry->offset],
+               keys[k].stored_size);
+    }
+}
+
+static int write_file(const char *path, const uint8_t *data, uint32_t size)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(data, 1, size, fp) != size)
+    {
+        perror(path);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    vol_t vols[MAX_VOLS];
+    pack_t packs[MAX_VOLS];
+    const char *pack_dir = NULL;
+    char *keep_raw[MAX_KEEP_RAW];
+    int num_keep_raw = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "z:k:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'z':
+            pack_dir = optarg;
+            break;
+        case 'k':
+            if (num_keep_raw < MAX_KEEP_RAW)
+            {
+                keep_raw[num_keep_raw++] = optarg;
+                break;
+            }
+            //fall through
+        default:
+            fprintf(stderr, "Usage: %s [-z <pack dir>] [-k <name>]... <out.bin> <vol files...>\n", argv[0]);
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    int num_vols = argc - 2;
+    if (argc < 3 || num_vols > MAX_VOLS)
+    {
+        fprintf(stderr, "Usage: %s [-z <pack dir>] [-k <name>]... <out.bin> <vol files...>\n", argv[0]);
+        return 1;
+    }
+
+    int num_keys = 0;
+    for (int i = 0; i < num_vols; i++)
+    {
+        if (vol_load(&vols[i], argv[i + 2]) != 0)
+        {
+            return 1;
+        }
+        num_keys += vols[i].num_entries;
+    }
+
+    //Collect the keys. Later duplicates in the same archive are dropped, the game only ever finds the first.
+    index_key_t *keys = calloc(num_keys, sizeof(index_key_t));
+    int n = 0;
+    for (int v = 0; v < num_vols; v++)
+    {
+        for (int e = 0; e < vols[v].num_entries; e++)
+        {
+            if (vol_find(&vols[v], vols[v].entries[e].name) != &vols[v].entries[e])
+            {
+                continue;
+            }
+            keys[n].entry = &vols[v].entries[e];
+            keys[n].archive = v;
+            keys[n].offset = vols[v].entries[e].offset;
+            keys[n].stored_size = vols[v].entries[e].size;
+            if (pack_dir != NULL)
+            {
+                pack_entry(&keys[n], &vols[v], keep_raw, num_keep_raw);
+            }
+            n++;
+        }
+    }
+    num_keys = n;
+
+    if (pack_dir != NULL)
+    {
+        for (int v = 0; v < num_vols; v++)
+        {
+            pack_archive(&packs[v], &vols[v], v, keys, num_keys);
+        }
+    }
+
+    uint32_t num_buckets = (num_keys + 3) / 4;
+    uint32_t num_slots = 1;
+    while (num_slots < num_keys + num_keys / 4)
+    {
+        num_slots <<= 1;
+    }
+    if (num_keys >= VOL_INDEX_EMPTY || num_slots > 0x8000)
+    {
+        fprintf(stderr, "Too many entries to index (%d)\n", num_keys);
+        return 1;
+    }
+
+    uint32_t *bucket_sizes = calloc(num_buckets, sizeof(uint32_t));
+    uint32_t *order = calloc(num_buckets, sizeof(uint32_t));
+    uint16_t *displacement = calloc(num_buckets, sizeof(uint16_t));
+    uint16_t *slots = malloc(num_slots * sizeof(uint16_t));
+    memset(slots, 0xFF, num_slots * sizeof(uint16_t));
+    for (int k = 0; k < num_keys; k++)
+    {
+        keys[k].bucket = vol_index_bucket(keys[k].entry->name, keys[k].archive, num_buckets);
+        bucket_sizes[keys[k].bucket]++;
+    }
+    for (uint32_t b = 0; b < num_buckets; b++)
+    {
+        order[b] = b;
+    }
+    qsort_r(order, num_buckets, sizeof(uint32_t), bucket_size_cmp, bucket_sizes);
+
+    //Place the biggest buckets first, trying displacements until every key in the bucket lands in a free slot
+    for (uint32_t o = 0; o < num_buckets && bucket_sizes[order[o]] > 0; o++)
+    {
+        uint32_t b = order[o];
+        uint32_t d;
+        for (d = 0; d <= MAX_DISPLACEMENT; d++)
+        {
+            bool ok = true;
+            for (int k = 0; k < num_keys && ok; k++)
+            {
+                if (keys[k].bucket != b)
+                {
+                    continue;
+                }
+                uint32_t s = vol_index_slot(keys[k].entry->name, keys[k].archive, d, num_slots);
+                if (slots[s] != VOL_INDEX_EMPTY)
+                {
+                    ok = false;
+                    break;
+                }
+                slots[s] = k; //Claim it for now, undone below if the bucket does not fit
+            }
+            if (ok)
+            {
+                break;
+            }
+            for (int k = 0; k < num_keys; k++)
+            {
+                uint32_t s = vol_index_slot(keys[k].entry->name, keys[k].archive, d, num_slots);
+                if (keys[k].bucket == b && slots[s] == k)
+                {
+                    slots[s] = VOL_INDEX_EMPTY;
+                }
+            }
+        }
+        if (d > MAX_DISPLACEMENT)
+        {
+            fprintf(stderr, "Could not build a perfect hash\n");
+            return 1;
+        }
+        displacement[b] = d;
+    }
+
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    write_be32(fp, VOL_INDEX_MAGIC);
+    write_be16(fp, num_vols);
+    write_be16(fp, num_keys);
+    write_be16(fp, num_buckets);
+    write_be16(fp, num_slots);
+    write_be32(fp, VOL_INDEX_VERSION);
+
+    for (int v = 0; v < num_vols; v++)
+    {
+        char name[VOL_INDEX_ARCHIVE_LEN] = {0};
+        strncpy(name, base_name(vols[v].path), VOL_INDEX_ARCHIVE_LEN - 1);
+        fwrite(name, 1, VOL_INDEX_ARCHIVE_LEN, fp);
+    }
+    for (uint32_t b = 0; b < num_buckets; b++)
+    {
+        write_be16(fp, displacement[b]);
+    }
+    write_pad(fp, 4);
+    for (uint32_t s = 0; s < num_slots; s++)
+    {
+        write_be16(fp, slots[s]);
+    }
+    write_pad(fp, 4);
+    for (int k = 0; k < num_keys; k++)
+    {
+        char name[VOL_INDEX_NAME_LEN];
+        upper_name(name, keys[k].entry->name);
+        fwrite(name, 1, VOL_INDEX_NAME_LEN, fp);
+        write_be32(fp, keys[k].offset);
+        write_be32(fp, keys[k].entry->size);
+        write_be32(fp, keys[k].stored_size);
+        uint8_t archive[4] = {keys[k].archive, keys[k].flags, 0, 0};
+        fwrite(archive, 1, sizeof(archive), fp);
+    }
+    fclose(fp);
+
+    printf("%s: %d entries, %u buckets, %u slots\n", argv[1], num_keys, num_buckets, num_slots);
+
+    //Written after the index so make sees the archives as up to date with it
+    for (int v = 0; v < num_vols && pack_dir != NULL; v++)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", pack_dir, base_name(vols[v].path));
+        if (write_file(path, packs[v].data, packs[v].size) != 0)
+        {
+            return 1;
+        }
+        printf("%s: %u -> %u bytes (%u%%)\n", path, packs[v].raw_size, packs[v].size,
+               (unsigned)((uint64_t)packs[v].size * 100 / packs[v].raw_size));
+        free(packs[v].data);
+    }
+
+    for (int k = 0; k < num_keys; k++)
+    {
+        free(keys[k].stored);
+    }
+    for (int v = 0; v < num_vols; v++)
+    {
+        vol_free(&vols[v]);
+    }
+    return 0;
+}
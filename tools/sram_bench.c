@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: GPL-2.0
+
+//Drives n64_save.c on top of the emulated SRAM in host/sram_emu.c.
+//Runs a random open/seek/read/write/close workload through the filesystem_t hooks, checks every read
+//against a reference copy, then checks that saves survive a remount, a v1 migration and a cut write.
+//Reports the PI DMA transactions and bytes moved so layout and caching changes can be compared.
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "libdragon.h"
+#include "host/sram_emu.h"
+#include "n64/n64_sram.h"
+
+typedef struct sram_files_t
+{
+    const char *name;
+    uint32_t size;
+    uint32_t offset;
+} sram_files_t;
+int sramfs_init(sram_files_t *files, int num_files);
+int sramfs_sync(void);
+
+//Same table as n64_main.c
+#define MAX_SRAM_FILES 11
+static sram_files_t sram_files[MAX_SRAM_FILES] = {
+    {"COSMO1.CFG", 256, 0},
+    {"COSMO1.SV1", 128, 0},
+    {"COSMO1.SV2", 128, 0},
+    {"COSMO1.SV3", 128, 0},
+    {"COSMO1.SV4", 128, 0},
+    {"COSMO1.SV5", 128, 0},
+    {"COSMO1.SV6", 128, 0},
+    {"COSMO1.SV7", 128, 0},
+    {"COSMO1.SV8", 128, 0},
+    {"COSMO1.SV9", 128, 0},
+    {"COSMO1.N64", 64, 0},
+};
+
+//The sramfs file sizes include the 4 byte v1 magic number, which is not readable data
+#define DATA_SIZE(i) (sram_files[i].size - 4)
+
+static uint8_t reference[MAX_SRAM_FILES][256];
+static bool exists[MAX_SRAM_FILES];
+static filesystem_t *fs;
+static int failures = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void mount(void)
+{
+    sramfs_init(sram_files, MAX_SRAM_FILES);
+    fs = host_get_filesystem("sram:/");
+    assert(fs != NULL);
+}
+
+static void *open_file(int i, int flags)
+{
+    //libdragon strips the prefix but leaves the leading slash
+    char name[32];
+    snprintf(name, sizeof(name), "/%s", sram_files[i].name);
+    return fs->open(name, flags);
+}
+
+static void check(bool ok, const char *what, int i)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL: %s (%s)\n", what, sram_files[i].name);
+        failures++;
+    }
+}
+
+static void verify_all(const char *what)
+{
+    for (int i = 0; i < MAX_SRAM_FILES; i++)
+    {
+        void *file = open_file(i, O_RDONLY);
+        check((file != NULL) == exists[i], what, i);
+        if (file == NULL)
+        {
+            continue;
+        }
+        uint8_t buf[256];
+        int len = fs->read(file, buf, sizeof(buf));
+        check(len == (int)DATA_SIZE(i) && memcmp(buf, reference[i], len) == 0, what, i);
+        fs->close(file);
+    }
+}
+
+static void print_stats(const char *name, int ops, double ms)
+{
+    sram_emu_stats_t stats;
+    sram_emu_get_stats(&stats);
+    printf("%-10s %7d ops %8.2f ms | read %6u DMAs %8llu bytes | write %6u DMAs %8llu bytes | %.1f bytes written/op\n",
+           name, ops, ms, stats.read_dmas, (unsigned long long)stats.bytes_read,
+           stats.write_dmas, (unsigned long long)stats.bytes_written,
+           ops ? (double)stats.bytes_written / ops : 0.0);
+}
+
+//Random open/seek/read/write/close sessions, like the game saving and loading
+static void workload(int num_ops)
+{
+    sram_emu_reset_stats();
+    double start = now_ms();
+    for (int op = 0; op < num_ops; op++)
+    {
+        int i = rand() % MAX_SRAM_FILES;
+        void *file = open_file(i, O_RDWR);
+        if (!exists[i])
+        {
+            memset(reference[i], 0, sizeof(reference[i]));
+            exists[i] = true;
+        }
+
+        int accesses = 1 + rand() % 4;
+        for (int a = 0; a < accesses; a++)
+        {
+            int pos = fs->lseek(file, rand() % DATA_SIZE(i), SEEK_SET);
+            int len = 1 + rand() % 32;
+            uint8_t buf[64];
+            if (rand() % 3 == 0)
+            {
+                int got = fs->read(file, buf, len);
+                int expect = (pos + len > (int)DATA_SIZE(i)) ? (int)DATA_SIZE(i) - pos : len;
+                check(got == expect && memcmp(buf, &reference[i][pos], got) == 0, "read", i);
+            }
+            else
+            {
+                for (int b = 0; b < len; b++)
+                {
+                    buf[b] = rand();
+                }
+                int put = fs->write(file, buf, len);
+                memcpy(&reference[i][pos], buf, put);
+            }
+        }
+        fs->close(file);
+    }
+    print_stats("random", num_ops, now_ms() - start);
+}
+
+//A typical save: rewrite a whole save slot where only a few bytes actually change
+static void save_workload(int num_ops)
+{
+    sram_emu_reset_stats();
+    double start = now_ms();
+    for (int op = 0; op < num_ops; op++)
+    {
+        int i = 1 + rand() % 9;
+        reference[i][rand() % DATA_SIZE(i)]++;
+        void *file = open_file(i, O_RDWR);
+        fs->write(file, reference[i], DATA_SIZE(i));
+        fs->close(file);
+        exists[i] = true;
+    }
+    print_stats("save", num_ops, now_ms() - start);
+}
+
+//A damaged superblock on its own must not cost the v2 files their contents
+static void superblock_test(void)
+{
+    uint8_t *sram = sram_emu_data();
+    sram[0x1000] ^= 0xFF;
+    mount();
+    verify_all("damaged superblock");
+}
+
+//Build a v1 image with a few files present and check they come through the migration
+static void migration_test(void)
+{
+    uint8_t *sram = sram_emu_data();
+    memset(sram, 0xAA, 0x1000 + 0x1000);
+    memset(exists, 0, sizeof(exists));
+
+    uint32_t offset = 0;
+    for (int i = 0; i < MAX_SRAM_FILES; i++)
+    {
+        if (i % 3 == 0)
+        {
+            uint32_t magic = 0x64646464;
+            memcpy(&sram[offset], &magic, sizeof(magic));
+            for (uint32_t b = 0; b < DATA_SIZE(i); b++)
+            {
+                reference[i][b] = rand();
+            }
+            memcpy(&sram[offset + 4], reference[i], DATA_SIZE(i));
+            exists[i] = true;
+        }
+        offset += sram_files[i].size;
+    }
+
+    sram_emu_reset_stats();
+    double start = now_ms();
+    mount();
+    print_stats("migrate", 1, now_ms() - start);
+    verify_all("v1 migration");
+}
+
+//Contents of file i at a given generation. Consecutive generations differ in every other sector, so a save
+//writes several separate data runs before the slot header.
+static void generation_data(int i, int generation, uint8_t *buf)
+{
+    for (uint32_t b = 0; b < DATA_SIZE(i); b++)
+    {
+        int sector = b / SRAM_SECTOR_SIZE;
+        buf[b] = reference[i][b] ^ ((sector % 2 == generation % 2) ? generation : 0);
+    }
+}
+
+//Save generation g of file i with the power cut after every byte written, restoring the SRAM contents from
+//before the save each time. After every cut the file must mount as generation g - 1 or g, never a mix.
+static int torn_commit(int i, int generation)
+{
+    static uint8_t image[SRAM_SIZE];
+    uint8_t *sram = sram_emu_data();
+    uint8_t old_data[256], new_data[256];
+    generation_data(i, generation - 1, old_data);
+    generation_data(i, generation, new_data);
+    memcpy(image, sram, SRAM_SIZE);
+
+    int cuts = 0;
+    for (int n = 0; ; n++)
+    {
+        memcpy(sram, image, SRAM_SIZE);
+        mount();
+        sram_emu_reset_stats();
+        sram_emu_fail_after(n);
+        void *file = open_file(i, O_RDWR);
+        fs->write(file, new_data, DATA_SIZE(i));
+        fs->close(file);
+        sram_emu_fail_after(-1);
+
+        sram_emu_stats_t stats;
+        sram_emu_get_stats(&stats);
+        bool complete = stats.bytes_written <= (uint64_t)n;
+
+        mount();
+        file = open_file(i, O_RDONLY);
+        uint8_t buf[256];
+        int len = (file != NULL) ? fs->read(file, buf, sizeof(buf)) : 0;
+        if (file != NULL)
+        {
+            fs->close(file);
+        }
+        bool is_old = len == (int)DATA_SIZE(i) && memcmp(buf, old_data, len) == 0;
+        bool is_new = len == (int)DATA_SIZE(i) && memcmp(buf, new_data, len) == 0;
+        check(is_old || is_new, "torn write", i);
+        check(!complete || is_new, "completed write", i);
+        if (complete)
+        {
+            return cuts;
+        }
+        cuts++;
+    }
+}
+
+//A file has two slots that saves alternate between, so save each test file twice to cut a write into both.
+//The config file spans more sectors than a save slot, so it gets more data runs per save.
+static void torn_write_test(void)
+{
+    static const int test_files[] = {0, 1};
+    int cuts = 0;
+    for (int t = 0; t < (int)(sizeof(test_files) / sizeof(test_files[0])); t++)
+    {
+        int i = test_files[t];
+        uint8_t data[256];
+        generation_data(i, 0, data);
+        void *file = open_file(i, O_RDWR);
+        fs->write(file, data, DATA_SIZE(i));
+        fs->close(file);
+        exists[i] = true;
+
+        for (int generation = 1; generation <= 2; generation++)
+        {
+            cuts += torn_commit(i, generation);
+        }
+        generation_data(i, 2, reference[i]);
+    }
+    printf("torn write: %d cut points checked\n", cuts);
+}
+
+int main(int argc, char **argv)
+{
+    int num_ops = 10000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_ops = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ops] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(seed);
+
+    //Fresh SRAM is not zeroed
+    uint8_t *sram = sram_emu_data();
+    for (int i = 0; i < SRAM_SIZE; i++)
+    {
+        sram[i] = rand();
+    }
+
+    sram_emu_reset_stats();
+    double start = now_ms();
+    mount();
+    print_stats("format", 1, now_ms() - start);
+
+    workload(num_ops);
+    mount();
+    verify_all("remount");
+
+    save_workload(num_ops);
+    mount();
+    verify_all("remount after saves");
+
+    torn_write_test();
+    verify_all("after torn writes");
+
+    superblock_test();
+
+    migration_test();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "vol.h"
+
+static uint32_t get_le32(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+uint8_t *read_file(const char *path, uint32_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = malloc(len > 0 ? len : 1);
+    if (data == NULL || fread(data, 1, len, fp) != (size_t)len)
+    {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    *size = (uint32_t)len;
+    return data;
+}
+
+int vol_load(vol_t *vol, const char *path)
+{
+    memset(vol, 0, sizeof(vol_t));
+    vol->path = path;
+    vol->data = read_file(path, &vol->size);
+    if (vol->data == NULL || vol->size < VOL_ENTRY_SIZE)
+    {
+        fprintf(stderr, "Could not read %s\n", path);
+        return -1;
+    }
+
+    //The directory ends where the first file begins
+    uint32_t dir_size = get_le32(&vol->data[VOL_NAME_LEN]);
+    if (dir_size > vol->size)
+    {
+        fprintf(stderr, "%s: bad directory size\n", path);
+        return -1;
+    }
+
+    int max_entries = dir_size / VOL_ENTRY_SIZE;
+    vol->entries = calloc(max_entries, sizeof(vol_entry_t));
+    for (int i = 0; i < max_entries; i++)
+    {
+        const uint8_t *src = &vol->data[i * VOL_ENTRY_SIZE];
+        if (src[0] == '\0')
+        {
+            continue;
+        }
+        vol_entry_t *entry = &vol->entries[vol->num_entries];
+        memcpy(entry->name, src, VOL_NAME_LEN);
+        entry->offset = get_le32(&src[VOL_NAME_LEN]);
+        entry->size = get_le32(&src[VOL_NAME_LEN + 4]);
+        if (entry->offset + entry->size > vol->size)
+        {
+            fprintf(stderr, "%s: %s is out of bounds\n", path, entry->name);
+            return -1;
+        }
+        vol->num_entries++;
+    }
+    return 0;
+}
+
+void vol_free(vol_t *vol)
+{
+    free(vol->entries);
+    free(vol->data);
+    memset(vol, 0, sizeof(vol_t));
+}
+
+const vol_entry_t *vol_find(const vol_t *vol, const char *name)
+{
+    for (int i = 0; i < vol->num_entries; i++)
+    {
+        if (strcasecmp(vol->entries[i].name, name) == 0)
+        {
+            return &vol->entries[i];
+        }
+    }
+    return NULL;
+}
+
+//The game looks in the episode VOL first and then falls back to the STN
+const vol_entry_t *vol_find_any(vol_t *vols, int num_vols, const char *name, const vol_t **owner)
+{
+    for (int i = 0; i < num_vols; i++)
+    {
+        const vol_entry_t *entry = vol_find(&vols[i], name);
+        if (entry != NULL)
+        {
+            if (owner != NULL)
+            {
+                *owner = &vols[i];
+            }
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void put_be16(uint8_t *dst, uint16_t val)
+{
+    dst[0] = val >> 8;
+    dst[1] = val & 0xFF;
+}
+
+void put_be32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val >> 24;
+    dst[1] = (val >> 16) & 0xFF;
+    dst[2] = (val >> 8) & 0xFF;
+    dst[3] = val & 0xFF;
+}
+
+void write_be32(FILE *fp, uint32_t val)
+{
+    uint8_t buf[4];
+    put_be32(buf, val);
+    fwrite(buf, 1, sizeof(buf), fp);
+}
+
+void write_pad(FILE *fp, uint32_t alignment)
+{
+    while (ftell(fp) % alignment)
+    {
+        fputc(0, fp);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef _TOOLS_VOL_H
+#define _TOOLS_VOL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//Host side reader for the game's VOL/STN archives. The directory is a list of 20 byte entries:
+//a 12 byte file name followed by a little endian 32bit offset and size.
+#define VOL_ENTRY_SIZE 20
+#define VOL_NAME_LEN 12
+
+typedef struct vol_entry_t
+{
+    char name[VOL_NAME_LEN + 1];
+    uint32_t offset;
+    uint32_t size;
+} vol_entry_t;
+
+typedef struct vol_t
+{
+    const char *path;
+    uint8_t *data;
+    uint32_t size;
+    vol_entry_t *entries;
+    int num_entries;
+} vol_t;
+
+int vol_load(vol_t *vol, const char *path);
+void vol_free(vol_t *vol);
+const vol_entry_t *vol_find(const vol_t *vol, const char *name);
+const vol_entry_t *vol_find_any(vol_t *vols, int num_vols, const char *name, const vol_t **owner);
+
+uint8_t *read_file(const char *path, uint32_t *size);
+void put_be16(uint8_t *dst, uint16_t val);
+void put_be32(uint8_t *dst, uint32_t val);
+void write_be32(FILE *fp, uint32_t val);
+void write_pad(FILE *fp, uint32_t alignment);
+
+#endif